@@ -0,0 +1,90 @@
+#include "application.hh"
+#include "builtin_shaders.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+// Measures compute pipeline creation with an empty (cold) and a reloaded (warm) on-disk
+// pipeline cache. Pass SPIR-V compute shaders as arguments, the built-in empty shader is
+// used otherwise. Mesa keeps its own shader cache : run with MESA_SHADER_CACHE_DISABLE=true
+// to measure the VkPipelineCache alone.
+
+static std::vector<uint32_t> readSpirv(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("Can't open " + path + ".");
+    std::vector<char> bytes(std::istreambuf_iterator<char>(file), {});
+    if (bytes.size() % 4 != 0) throw std::runtime_error(path + " is not a SPIR-V binary.");
+    std::vector<uint32_t> code(bytes.size() / 4);
+    std::memcpy(code.data(), bytes.data(), bytes.size());
+    return code;
+}
+
+static double createPipelines(PhysicalDevice& physicalDevice, const std::string& cachePath,
+                              const std::vector<std::vector<uint32_t>>& shaders) {
+    LogicalDevice device(physicalDevice, cachePath);
+    VkDevice handle = device.getHandle();
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(handle, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout.");
+    }
+
+    std::vector<VkShaderModule> modules;
+    for (auto& code : shaders) {
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+        moduleInfo.pCode = code.data();
+        VkShaderModule module;
+        if (vkCreateShaderModule(handle, &moduleInfo, nullptr, &module) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module.");
+        }
+        modules.push_back(module);
+    }
+
+    std::vector<VkPipeline> pipelines(modules.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < modules.size(); i++) {
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = modules[i];
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
+        if (vkCreateComputePipelines(handle, device.getPipelineCache().getHandle(), 1,
+                                     &pipelineInfo, nullptr, &pipelines[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline.");
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    for (auto pipeline : pipelines) vkDestroyPipeline(handle, pipeline, nullptr);
+    for (auto module : modules) vkDestroyShaderModule(handle, module, nullptr);
+    vkDestroyPipelineLayout(handle, layout, nullptr);
+    return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::vector<uint32_t>> shaders;
+    for (int i = 1; i < argc; i++) shaders.push_back(readSpirv(argv[i]));
+    if (shaders.empty()) shaders.push_back(emptyComputeShader);
+
+    GlfwContext::getInstance();
+    VulkanContext::getInstance();
+    auto& physicalDevice = PhysicalDevice::pickDevice();
+    std::string cachePath = "pipeline_cache_bench.bin";
+    std::remove(cachePath.c_str());
+
+    double cold = createPipelines(physicalDevice, cachePath, shaders);
+    double warm = createPipelines(physicalDevice, cachePath, shaders);
+    std::remove(cachePath.c_str());
+
+    std::printf("pipelines: %zu\ncold: %.3f ms\nwarm: %.3f ms\nspeedup: %.2fx\n", shaders.size(),
+                cold, warm, warm > 0.0 ? cold / warm : 0.0);
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "allocator.hh"
+
+Buffer::Buffer(Allocator& allocator, const VkBufferCreateInfo& bufferInfo,
+               const VmaAllocationCreateInfo& allocationInfo)
+    : _allocator(allocator.getHandle()), _size(bufferInfo.size) {
+    VmaAllocationInfo info{};
+    VkResult result =
+        vmaCreateBuffer(_allocator, &bufferInfo, &allocationInfo, &_handle, &_allocation, &info);
+    if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY &&
+        allocator.handleOutOfMemory(bufferInfo, allocationInfo)) {
+        result = vmaCreateBuffer(_allocator, &bufferInfo, &allocationInfo, &_handle, &_allocation,
+                                 &info);
+    }
+    if (result != VK_SUCCESS) throw std::runtime_error("Failed to create buffer.");
+    _mappedData = info.pMappedData;
+}
+
+Buffer::Buffer(Allocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+               VmaMemoryUsage memoryUsage /* = VMA_MEMORY_USAGE_AUTO */,
+               VmaAllocationCreateFlags flags /* = 0 */) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocationInfo{};
+    allocationInfo.usage = memoryUsage;
+    allocationInfo.flags = flags;
+
+    *this = Buffer(allocator, bufferInfo, allocationInfo);
+}
+
+Image::Image(Allocator& allocator, const VkImageCreateInfo& imageInfo,
+             const VmaAllocationCreateInfo& allocationInfo)
+    : _allocator(allocator.getHandle()),
+      _extent(imageInfo.extent),
+      _format(imageInfo.format),
+      _mipLevels(imageInfo.mipLevels) {
+    VkResult result =
+        vmaCreateImage(_allocator, &imageInfo, &allocationInfo, &_handle, &_allocation, nullptr);
+    if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY &&
+        allocator.handleOutOfMemory(imageInfo, allocationInfo)) {
+        result = vmaCreateImage(_allocator, &imageInfo, &allocationInfo, &_handle, &_allocation,
+                                nullptr);
+    }
+    if (result != VK_SUCCESS) throw std::runtime_error("Failed to create image.");
+}
+
+Image::Image(Allocator& allocator, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage,
+             uint32_t mipLevels /* = 1 */, VmaMemoryUsage memoryUsage /* = VMA_MEMORY_USAGE_AUTO */,
+             VmaAllocationCreateFlags flags /* = 0 */) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo allocationInfo{};
+    allocationInfo.usage = memoryUsage;
+    allocationInfo.flags = flags;
+
+    *this = Image(allocator, imageInfo, allocationInfo);
+}
+
+Allocator::Allocator(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device,
+                     uint32_t apiVersion, VmaAllocatorCreateFlags flags /* = 0 */)
+    : _device(device) {
+    VmaAllocatorCreateInfo createInfo{};
+    createInfo.flags = flags;
+    createInfo.instance = instance;
+    createInfo.physicalDevice = physicalDevice;
+    createInfo.device = device;
+    createInfo.vulkanApiVersion = apiVersion;
+
+    if (vmaCreateAllocator(&createInfo, &_handle) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create memory allocator.");
+    }
+    std::cerr << "Memory allocator successfully created.\n";
+}
+
+VmaStatistics Allocator::getStatistics() const {
+    VmaTotalStatistics stats{};
+    vmaCalculateStatistics(_handle, &stats);
+    return stats.total.statistics;
+}
+
+std::vector<VmaBudget> Allocator::getHeapBudgets() const {
+    const VkPhysicalDeviceMemoryProperties* properties;
+    vmaGetMemoryProperties(_handle, &properties);
+    std::vector<VmaBudget> budgets(VK_MAX_MEMORY_HEAPS);
+    vmaGetHeapBudgets(_handle, budgets.data());
+    budgets.resize(properties->memoryHeapCount);
+    return budgets;
+}
+
+bool Allocator::handleOutOfMemory(const VkBufferCreateInfo& createInfo,
+                                  const VmaAllocationCreateInfo& allocationInfo) {
+    if (!_outOfMemoryHandler || allocationInfo.pool != VK_NULL_HANDLE) return false;
+    VkBuffer buffer;
+    if (vkCreateBuffer(_device, &createInfo, nullptr, &buffer) != VK_SUCCESS) return false;
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(_device, buffer, &requirements);
+    vkDestroyBuffer(_device, buffer, nullptr);
+    if (allocationInfo.memoryTypeBits != 0) {
+        requirements.memoryTypeBits &= allocationInfo.memoryTypeBits;
+    }
+    return _outOfMemoryHandler(requirements);
+}
+
+bool Allocator::handleOutOfMemory(const VkImageCreateInfo& createInfo,
+                                  const VmaAllocationCreateInfo& allocationInfo) {
+    if (!_outOfMemoryHandler || allocationInfo.pool != VK_NULL_HANDLE) return false;
+    VkImage image;
+    if (vkCreateImage(_device, &createInfo, nullptr, &image) != VK_SUCCESS) return false;
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(_device, image, &requirements);
+    vkDestroyImage(_device, image, nullptr);
+    if (allocationInfo.memoryTypeBits != 0) {
+        requirements.memoryTypeBits &= allocationInfo.memoryTypeBits;
+    }
+    return _outOfMemoryHandler(requirements);
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "vk_mem_alloc.hh"
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+class Allocator;
+
+// Buffer backed by a VMA sub-allocation. Destroying the wrapper releases both the VkBuffer and
+// its slice of device memory.
+class Buffer {
+public:
+    Buffer() = default;
+    Buffer(Allocator& allocator, const VkBufferCreateInfo& bufferInfo,
+           const VmaAllocationCreateInfo& allocationInfo);
+    Buffer(Allocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+           VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_AUTO, VmaAllocationCreateFlags flags = 0);
+    ~Buffer() {
+        destroy();
+    }
+
+    Buffer(Buffer&& other) noexcept {
+        *this = std::move(other);
+    }
+    Buffer& operator=(Buffer&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            _allocator = std::exchange(other._allocator, VK_NULL_HANDLE);
+            _handle = std::exchange(other._handle, VK_NULL_HANDLE);
+            _allocation = std::exchange(other._allocation, VK_NULL_HANDLE);
+            _size = std::exchange(other._size, 0);
+            _mappedData = std::exchange(other._mappedData, nullptr);
+        }
+        return *this;
+    }
+    Buffer(Buffer const&) = delete;
+    void operator=(Buffer const&) = delete;
+
+    VkBuffer getHandle() const {
+        return _handle;
+    }
+
+    VmaAllocation getAllocation() const {
+        return _allocation;
+    }
+
+    VkDeviceSize getSize() const {
+        return _size;
+    }
+
+    // Non-null only for allocations created with VMA_ALLOCATION_CREATE_MAPPED_BIT.
+    void* getMappedData() const {
+        return _mappedData;
+    }
+
+private:
+    // Swaps the handle of moved buffers.
+    friend class Defragmenter;
+
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    VkBuffer _handle = VK_NULL_HANDLE;
+    VmaAllocation _allocation = VK_NULL_HANDLE;
+    VkDeviceSize _size = 0;
+    void* _mappedData = nullptr;
+
+    void destroy() {
+        if (_handle != VK_NULL_HANDLE) vmaDestroyBuffer(_allocator, _handle, _allocation);
+        _handle = VK_NULL_HANDLE;
+        _allocation = VK_NULL_HANDLE;
+    }
+};
+
+// Image backed by a VMA sub-allocation, same ownership rules as Buffer.
+class Image {
+public:
+    Image() = default;
+    Image(Allocator& allocator, const VkImageCreateInfo& imageInfo,
+          const VmaAllocationCreateInfo& allocationInfo);
+    Image(Allocator& allocator, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage,
+          uint32_t mipLevels = 1, VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_AUTO,
+          VmaAllocationCreateFlags flags = 0);
+    ~Image() {
+        destroy();
+    }
+
+    Image(Image&& other) noexcept {
+        *this = std::move(other);
+    }
+    Image& operator=(Image&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            _allocator = std::exchange(other._allocator, VK_NULL_HANDLE);
+            _handle = std::exchange(other._handle, VK_NULL_HANDLE);
+            _allocation = std::exchange(other._allocation, VK_NULL_HANDLE);
+            _extent = other._extent;
+            _format = other._format;
+            _mipLevels = other._mipLevels;
+        }
+        return *this;
+    }
+    Image(Image const&) = delete;
+    void operator=(Image const&) = delete;
+
+    VkImage getHandle() const {
+        return _handle;
+    }
+
+    VmaAllocation getAllocation() const {
+        return _allocation;
+    }
+
+    VkExtent3D getExtent() const {
+        return _extent;
+    }
+
+    VkFormat getFormat() const {
+        return _format;
+    }
+
+    uint32_t getMipLevels() const {
+        return _mipLevels;
+    }
+
+private:
+    friend class Defragmenter;
+
+    VmaAllocator _allocator = VK_NULL_HANDLE;
+    VkImage _handle = VK_NULL_HANDLE;
+    VmaAllocation _allocation = VK_NULL_HANDLE;
+    VkExtent3D _extent = {0, 0, 0};
+    VkFormat _format = VK_FORMAT_UNDEFINED;
+    uint32_t _mipLevels = 0;
+
+    void destroy() {
+        if (_handle != VK_NULL_HANDLE) vmaDestroyImage(_allocator, _handle, _allocation);
+        _handle = VK_NULL_HANDLE;
+        _allocation = VK_NULL_HANDLE;
+    }
+};
+
+// Owns the VmaAllocator of a LogicalDevice. Resources are sub-allocated from large
+// VkDeviceMemory blocks so the number of driver allocations stays far below
+// maxMemoryAllocationCount even with tens of thousands of buffers and images.
+class Allocator {
+public:
+    // Called when an allocation fails for lack of device memory, with the memory requirements
+    // of the resource. Returns whether memory was released, in which case the allocation is
+    // tried once more.
+    using OutOfMemoryHandler = std::function<bool(const VkMemoryRequirements&)>;
+
+    Allocator(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device,
+              uint32_t apiVersion, VmaAllocatorCreateFlags flags = 0);
+    ~Allocator() {
+        vmaDestroyAllocator(_handle);
+        std::cerr << "Destroyed memory allocator.\n";
+    }
+
+    Allocator(Allocator const&) = delete;
+    void operator=(Allocator const&) = delete;
+
+    VmaAllocator getHandle() const {
+        return _handle;
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                        VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_AUTO,
+                        VmaAllocationCreateFlags flags = 0) {
+        return Buffer(*this, size, usage, memoryUsage, flags);
+    }
+
+    Image createImage(VkExtent2D extent, VkFormat format, VkImageUsageFlags usage,
+                      uint32_t mipLevels = 1, VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_AUTO,
+                      VmaAllocationCreateFlags flags = 0) {
+        return Image(*this, extent, format, usage, mipLevels, memoryUsage, flags);
+    }
+
+    // Number of VkDeviceMemory blocks and of sub-allocations currently alive.
+    VmaStatistics getStatistics() const;
+
+    // Usage and budget of every memory heap, see BudgetMonitor.
+    std::vector<VmaBudget> getHeapBudgets() const;
+
+    void setOutOfMemoryHandler(OutOfMemoryHandler handler) {
+        _outOfMemoryHandler = std::move(handler);
+    }
+
+    // Requirements are those of a temporary resource created from createInfo, narrowed to the
+    // memory types allocationInfo allows. Allocations from a custom pool are left alone : a
+    // capped pool is full of its own resources, which only its owner can release.
+    bool handleOutOfMemory(const VkBufferCreateInfo& createInfo,
+                           const VmaAllocationCreateInfo& allocationInfo);
+    bool handleOutOfMemory(const VkImageCreateInfo& createInfo,
+                           const VmaAllocationCreateInfo& allocationInfo);
+
+private:
+    VmaAllocator _handle = VK_NULL_HANDLE;
+    VkDevice _device;
+    OutOfMemoryHandler _outOfMemoryHandler;
+};
@@ -1,5 +1,9 @@
 #include "application.hh"
 
+#include <thread>
+
+#include "device_scorer.hh"
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
               VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -34,12 +38,31 @@ bool VulkanContext::checkValidationLayerSupport() {
     return true;
 }
 
-std::vector<const char*> VulkanContext::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+static bool isInstanceExtensionAvailable(const char* name) {
+    uint32_t extensionCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(name, extension.extensionName) == 0) return true;
+    }
+    return false;
+}
 
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+std::vector<const char*> VulkanContext::getRequiredExtensions() {
+    std::vector<const char*> extensions;
+    if (isHeadless()) {
+        if (isInstanceExtensionAvailable(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME)) {
+            extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+            extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+            _headlessSurface = true;
+        }
+    } else {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -70,6 +93,21 @@ void VulkanContext::DestroyDebugUtilsMessengerEXT(VkInstance instance,
     }
 }
 
+VkSurfaceKHR VulkanContext::createHeadlessSurface() const {
+    auto func = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(
+        _handle, "vkCreateHeadlessSurfaceEXT");
+    if (!_headlessSurface || func == nullptr) {
+        throw std::runtime_error("VK_EXT_headless_surface isn't available.");
+    }
+    VkHeadlessSurfaceCreateInfoEXT createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+    VkSurfaceKHR surface;
+    if (func(_handle, &createInfo, nullptr, &surface) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create headless surface.");
+    }
+    return surface;
+}
+
 void VulkanContext::populateDebugMessengerCreateInfo(
     VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
     createInfo = {};
@@ -95,9 +133,24 @@ void VulkanContext::setupDebugMessenger() {
     }
 }
 
-VulkanContext::VulkanContext() {
-    if (enableValidationLayers && !checkValidationLayerSupport()) {
-        throw std::runtime_error("Can't support validation layers.");
+uint32_t VulkanContext::negotiateApiVersion() {
+    // Runs before the VulkanContext phase, and is the first call into the loader.
+    StartupPhase phase("negotiateApiVersion");
+    // vkEnumerateInstanceVersion doesn't exist in 1.0 loaders.
+    auto func = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr,
+                                                                      "vkEnumerateInstanceVersion");
+    uint32_t loaderVersion = VK_API_VERSION_1_0;
+    if (func != nullptr && func(&loaderVersion) != VK_SUCCESS) loaderVersion = VK_API_VERSION_1_0;
+    return std::min(loaderVersion, VK_API_VERSION_1_2);
+}
+
+VulkanContext::VulkanContext() : _apiVersion(negotiateApiVersion()) {
+    StartupPhase phase("VulkanContext");
+    if (enableValidationLayers) {
+        StartupPhase validationPhase("checkValidationLayerSupport");
+        if (!checkValidationLayerSupport()) {
+            throw std::runtime_error("Can't support validation layers.");
+        }
     }
 
     VkApplicationInfo appInfo{};
@@ -106,7 +159,7 @@ VulkanContext::VulkanContext() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "None";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = _apiVersion;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -126,20 +179,28 @@ VulkanContext::VulkanContext() {
         createInfo.pNext = nullptr;
     }
 
-    auto result = vkCreateInstance(&createInfo, nullptr, &_handle);
+    VkResult result;
+    {
+        StartupPhase createPhase("vkCreateInstance");
+        result = vkCreateInstance(&createInfo, nullptr, &_handle);
+    }
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Error while creating Vulkan instance.");
     }
-    std::cerr << "Vulkan instance successfully created.\n";
+    std::cerr << "Vulkan instance successfully created (API " << VK_API_VERSION_MAJOR(_apiVersion)
+              << "." << VK_API_VERSION_MINOR(_apiVersion) << ").\n";
 
     setupDebugMessenger();
 }
 
-std::vector<PhysicalDevice>& PhysicalDevice::getPhysicalDevices(bool force /* = false */) {
-    static std::vector<PhysicalDevice> availableDevices = {};
-    if (force) availableDevices = {};
-    if (availableDevices.size() > 0) return availableDevices;
+const std::vector<PhysicalDevice*>& PhysicalDevice::getPhysicalDevices(
+    bool force /* = false */) {
+    // Every device ever enumerated, never moved nor removed.
+    static std::deque<PhysicalDevice> knownDevices;
+    static std::vector<PhysicalDevice*> availableDevices;
+    if (!force && availableDevices.size() > 0) return availableDevices;
 
+    StartupPhase phase("PhysicalDevice::getPhysicalDevices");
     std::cout << "Fetching physical devices available : \n";
 
     auto& instance = VulkanContext::getInstance();
@@ -151,22 +212,256 @@ std::vector<PhysicalDevice>& PhysicalDevice::getPhysicalDevices(bool force /* =
     std::vector<VkPhysicalDevice> deviceHandles(deviceCount);
     vkEnumeratePhysicalDevices(instance.getHandle(), &deviceCount, deviceHandles.data());
 
+    // Devices seen by a previous enumeration keep their properties and probe, so a hot-plug
+    // event only queries the new ones.
+    std::vector<PhysicalDevice*> devices;
     for (auto& deviceHandle : deviceHandles) {
-        availableDevices.push_back(PhysicalDevice(deviceHandle));
+        auto known = std::find_if(
+            knownDevices.begin(), knownDevices.end(),
+            [&](const PhysicalDevice& device) { return device._handle == deviceHandle; });
+        if (known != knownDevices.end()) {
+            devices.push_back(&*known);
+            continue;
+        }
+        StartupPhase probePhase("PhysicalDevice " + std::to_string(devices.size()));
+        knownDevices.push_back(PhysicalDevice(deviceHandle));
+        devices.push_back(&knownDevices.back());
     }
+    availableDevices = std::move(devices);
     return availableDevices;
 }
 
-PhysicalDevice& PhysicalDevice::pickDevice(bool force /* = false*/) {
-    auto& availableDevices = getPhysicalDevices();
-    for (auto& device : availableDevices) {
-        if (device._deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-            return device;
+PhysicalDevice& PhysicalDevice::pickDevice(
+    bool force /* = false*/, Selection selection /* = Selection::FirstDiscrete */) {
+    auto& availableDevices = getPhysicalDevices(force);
+    if (selection != Selection::FirstDiscrete) {
+        // Scoring reads every device's queue families and memory heaps.
+        probeAll();
+        DeviceScorer scorer;
+        PhysicalDevice* best = nullptr;
+        double bestScore = 0.0;
+        for (auto* device : availableDevices) {
+            auto score = scorer.score(*device, selection == Selection::Benchmarked);
+            std::cout << "Score of " << device->getName() << " : " << score.total << '\n';
+            if (best == nullptr || score.total > bestScore) {
+                best = device;
+                bestScore = score.total;
+            }
+        }
+        return *best;
+    }
+    for (auto* device : availableDevices) {
+        if (device->_deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+            return *device;
+        }
+    }
+    for (auto* device : availableDevices) {
+        if (device->_deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
+            return *device;
+    }
+    return *availableDevices[0];
+}
+
+void PhysicalDevice::probeAll(bool parallel /* = true */) {
+    auto& devices = getPhysicalDevices();
+    if (!parallel || devices.size() == 1) {
+        for (auto* device : devices) device->probe();
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (auto* device : devices) threads.emplace_back([device]() { device->probe(); });
+    for (auto& thread : threads) thread.join();
+}
+
+const PhysicalDevice::Probe& PhysicalDevice::probe() const {
+    std::call_once(_probe->once, [this]() {
+        StartupPhase phase("Probe " + getName());
+        auto& probe = *_probe;
+        vkGetPhysicalDeviceFeatures(_handle, &probe.features);
+        probe.vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        if (getApiVersion() >= VK_API_VERSION_1_2) {
+            VkPhysicalDeviceFeatures2 features{};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &probe.vulkan12Features;
+            vkGetPhysicalDeviceFeatures2(_handle, &features);
+            probe.vulkan12Features.pNext = nullptr;
+
+            probe.vulkan12Properties.sType =
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+            VkPhysicalDeviceProperties2 properties{};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties.pNext = &probe.vulkan12Properties;
+            vkGetPhysicalDeviceProperties2(_handle, &properties);
+            probe.vulkan12Properties.pNext = nullptr;
         }
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(_handle, nullptr, &extensionCount, nullptr);
+        probe.extensions = std::vector<VkExtensionProperties>(extensionCount);
+        vkEnumerateDeviceExtensionProperties(_handle, nullptr, &extensionCount,
+                                             probe.extensions.data());
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(_handle, &queueFamilyCount, nullptr);
+        probe.queueFamilies = std::vector<VkQueueFamilyProperties>(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(_handle, &queueFamilyCount,
+                                                 probe.queueFamilies.data());
+        vkGetPhysicalDeviceMemoryProperties(_handle, &probe.memoryProperties);
+    });
+    return *_probe;
+}
+
+LogicalDevice::LogicalDevice(PhysicalDevice& physicalDevice,
+                             const std::string& pipelineCachePath /* = "" */)
+    : _physicalDevice(physicalDevice) {
+    StartupPhase phase("LogicalDevice");
+    // Transfer and compute fall back to the graphics family, where they still get their own
+    // queue if the family exposes more than one.
+    uint32_t graphicsFamily = physicalDevice.getBestGraphicsFamilyIndex();
+    std::array<uint32_t, queueRoleCount> roleFamilies = {
+        graphicsFamily, physicalDevice.getAsyncComputeFamilyIndex().value_or(graphicsFamily),
+        physicalDevice.getDedicatedTransferFamilyIndex().value_or(graphicsFamily)};
+
+    auto& familyProperties = physicalDevice.getQueueFamilyProperties();
+    std::vector<uint32_t> queueCounts(familyProperties.size(), 0);
+    std::array<uint32_t, queueRoleCount> roleIndices;
+    for (size_t role = 0; role < queueRoleCount; role++) {
+        uint32_t family = roleFamilies[role];
+        roleIndices[role] = std::min(queueCounts[family], familyProperties[family].queueCount - 1);
+        queueCounts[family] = std::max(queueCounts[family], roleIndices[role] + 1);
+    }
+
+    std::vector<float> queuePriorities(queueRoleCount, 1.0f);
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (uint32_t family = 0; family < queueCounts.size(); family++) {
+        if (queueCounts[family] == 0) continue;
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = family;
+        queueCreateInfo.queueCount = queueCounts[family];
+        queueCreateInfo.pQueuePriorities = queuePriorities.data();
+        queueCreateInfos.push_back(queueCreateInfo);
     }
-    for (auto& device : availableDevices) {
-        if (device._deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
-            return device;
+
+    VkPhysicalDeviceFeatures deviceFeatures{};
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    auto& supported = physicalDevice.getVulkan12Features();
+    vulkan12Features.timelineSemaphore = supported.timelineSemaphore;
+    _timelineSemaphores = vulkan12Features.timelineSemaphore == VK_TRUE;
+    vulkan12Features.hostQueryReset = supported.hostQueryReset;
+    _hostQueryReset = vulkan12Features.hostQueryReset == VK_TRUE;
+    bool bindless = BindlessTable::isSupported(supported);
+    if (bindless) {
+        vulkan12Features.descriptorIndexing = VK_TRUE;
+        vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        vulkan12Features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    }
+
+    VkDeviceCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    if (physicalDevice.getApiVersion() >= VK_API_VERSION_1_2) createInfo.pNext = &vulkan12Features;
+    createInfo.pQueueCreateInfos = queueCreateInfos.data();
+    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+    createInfo.pEnabledFeatures = &deviceFeatures;
+
+    // The swapchain is only of use when the instance can create surfaces.
+    auto& context = VulkanContext::getInstance();
+    bool surfaces = !VulkanContext::isHeadless() || context.hasHeadlessSurface();
+    if (surfaces && physicalDevice.isExtensionSupported(VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+        _extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    // VMA reads the budgets with vkGetPhysicalDeviceMemoryProperties2, core since 1.1.
+    bool memoryBudget = physicalDevice.getApiVersion() >= VK_API_VERSION_1_1 &&
+                        physicalDevice.isExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudget) _extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(_extensions.size());
+    createInfo.ppEnabledExtensionNames = _extensions.data();
+
+    if (context.enableValidationLayers) {
+        createInfo.enabledLayerCount = static_cast<uint32_t>(context.validationLayers.size());
+        createInfo.ppEnabledLayerNames = context.validationLayers.data();
+    } else {
+        createInfo.enabledLayerCount = 0;
+    }
+    VkResult result;
+    {
+        StartupPhase createPhase("vkCreateDevice");
+        result = vkCreateDevice(physicalDevice.getHandle(), &createInfo, nullptr, &_handle);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create logical device!");
+    }
+    // The destructor won't run if a later step throws : release what was built until then.
+    struct Guard {
+        LogicalDevice* device;
+        ~Guard() {
+            if (device) device->release();
+        }
+    } guard{this};
+
+    for (size_t role = 0; role < queueRoleCount; role++) {
+        for (auto& queue : _queues) {
+            if (queue->getFamilyIndex() == roleFamilies[role] &&
+                queue->getIndex() == roleIndices[role]) {
+                _roleQueues[role] = queue.get();
+            }
+        }
+        if (_roleQueues[role] == nullptr) {
+            _queues.push_back(std::make_unique<Queue>(_handle, roleFamilies[role], roleIndices[role]));
+            _roleQueues[role] = _queues.back().get();
+        }
+        _commandPools[role] =
+            std::make_unique<CommandPoolManager>(_handle, roleFamilies[role], maxFramesInFlight);
+    }
+    std::cerr << "Queue families : graphics " << roleFamilies[0] << ", compute " << roleFamilies[1]
+              << ", transfer " << roleFamilies[2] << " (" << _queues.size() << " queue(s)).\n";
+
+    {
+        StartupPhase allocatorPhase("Allocator");
+        _allocator = std::make_unique<Allocator>(
+            context.getHandle(), physicalDevice.getHandle(), _handle,
+            physicalDevice.getApiVersion(),
+            memoryBudget ? VmaAllocatorCreateFlags(VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT) : 0);
+        _memoryPools = std::make_unique<MemoryPools>(
+            *_allocator, physicalDevice.getProperties().limits, maxFramesInFlight);
+    }
+    {
+        StartupPhase pipelineCachePhase("PipelineCache");
+        _pipelineCache = std::make_unique<PipelineCache>(
+            _handle, physicalDevice.getProperties(),
+            pipelineCachePath.empty() ? PipelineCache::defaultPath(physicalDevice.getProperties())
+                                      : pipelineCachePath);
+    }
+    _profiler = std::make_unique<Profiler>(_handle, physicalDevice.getProperties(), familyProperties,
+                                           roleFamilies, maxFramesInFlight);
+    _budgetMonitor = std::make_unique<BudgetMonitor>(*_allocator, memoryBudget, _profiler.get());
+    // Transient buffers come back on the next allocation, streamed data has to be uploaded again.
+    auto& pools = *_memoryPools;
+    _budgetMonitor->addEvictor(
+        [&pools](uint32_t heap, VkDeviceSize bytes) -> VkDeviceSize {
+            if (heap != pools.getTransient().getHeapIndex()) return 0;
+            return pools.getTransientArena().evict(bytes);
+        },
+        0);
+    _budgetMonitor->addEvictor(
+        [&pools](uint32_t heap, VkDeviceSize bytes) -> VkDeviceSize {
+            if (heap != pools.getStreaming().getHeapIndex()) return 0;
+            return pools.getStreamingCache().evict(bytes);
+        },
+        1);
+    _layoutCache = std::make_unique<LayoutCache>(_handle);
+    if (bindless) {
+        _bindlessTable = std::make_unique<BindlessTable>(
+            _handle, physicalDevice.getVulkan12Properties(), maxFramesInFlight);
+    } else {
+        std::cerr << "Descriptor indexing unavailable, no bindless table.\n";
     }
-    return availableDevices[0];
+    _defragmenter = std::make_unique<Defragmenter>(*this);
+    _defragmenter->addPool(_memoryPools->getGeneralBuffers());
+    _defragmenter->addPool(_memoryPools->getGeneralImages());
+    guard.device = nullptr;
 }
\ No newline at end of file
@@ -5,11 +5,27 @@
 #include <GLFW/glfw3.h>
 
 #include <algorithm>
+#include <array>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "allocator.hh"
+#include "bindless_table.hh"
+#include "budget_monitor.hh"
+#include "command_pool.hh"
+#include "defragmenter.hh"
+#include "layout_cache.hh"
+#include "memory_pools.hh"
+#include "pipeline_cache.hh"
+#include "profiler.hh"
+#include "queue.hh"
+#include "startup_timer.hh"
 #include "utils.hh"
 
 class GlfwContext {
@@ -21,6 +37,7 @@ public:
 
 private:
     GlfwContext() {
+        StartupPhase phase("GlfwContext");
         if (glfwInit() == GLFW_FALSE)
             throw std::runtime_error("GLFW library initialisation failed.");
         std::cerr << "GLFW library successfully initialised.\n";
@@ -49,14 +66,44 @@ public:
         return instance;
     }
 
+    // Must be set before the first getInstance() : a headless context never touches GLFW.
+    static void setHeadless(bool headless) {
+        headlessMode() = headless;
+    }
+
+    static bool isHeadless() {
+        return headlessMode();
+    }
+
+    // Whether VK_EXT_headless_surface is enabled. Offscreen rendering doesn't need it.
+    bool hasHeadlessSurface() const {
+        return _headlessSurface;
+    }
+
+    VkSurfaceKHR createHeadlessSurface() const;
+
     const VkInstance& getHandle() const {
         return _handle;
     }
 
+    uint32_t getApiVersion() const {
+        return _apiVersion;
+    }
+
 private:
     VkInstance _handle;
+    uint32_t _apiVersion;
+    bool _headlessSurface = false;
     VkDebugUtilsMessengerEXT _debugMessenger;
 
+    // Highest version both the loader and this code support, 1.2 at most.
+    static uint32_t negotiateApiVersion();
+
+    static bool& headlessMode() {
+        static bool headless = false;
+        return headless;
+    }
+
     bool checkValidationLayerSupport();
     std::vector<const char*> getRequiredExtensions();
     VkResult CreateDebugUtilsMessengerEXT(VkInstance instance,
@@ -85,6 +132,7 @@ public:
 class Window {
 private:
     GLFWwindow* _handle = nullptr;
+    VkSurfaceKHR _surface = VK_NULL_HANDLE;
     uint32_t _width;
     uint32_t _height;
     std::string _name;
@@ -97,20 +145,59 @@ public:
 
     void create(GLFWmonitor* monitor = nullptr, bool resizeable = false) {
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, resizeable ? GLFW_TRUE : GLFW_FALSE);
 
         _handle = glfwCreateWindow(_width, _height, "Vulkan", monitor, nullptr);
+        if (_handle == nullptr) throw std::runtime_error("Failed to create window.");
+    }
+
+    // Created on first call, once the window exists, and destroyed with the window.
+    VkSurfaceKHR getSurface() {
+        if (_surface != VK_NULL_HANDLE) return _surface;
+        if (glfwCreateWindowSurface(VulkanContext::getInstance().getHandle(), _handle, nullptr,
+                                    &_surface) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create window surface.");
+        }
+        return _surface;
+    }
+
+    VkExtent2D getFramebufferExtent() const {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(_handle, &width, &height);
+        return {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+    }
+
+    GLFWwindow* getHandle() const {
+        return _handle;
     }
 
     ~Window() {
+        if (_surface) {
+            vkDestroySurfaceKHR(VulkanContext::getInstance().getHandle(), _surface, nullptr);
+        }
         if (_handle) glfwDestroyWindow(_handle);
     }
 };
 
+// Only the properties are queried up front, which is all pickDevice() needs. Features,
+// extensions and queue families are probed on first use, once per device : devices that are
+// never used are never probed, and probes survive getPhysicalDevices(true).
+//
+// Devices live at stable addresses for the whole process : re-enumerating only adds the new
+// ones, so references handed out before (pickDevice(), LogicalDevice, DevicePool) stay valid.
 class PhysicalDevice {
 public:
-    static std::vector<PhysicalDevice>& getPhysicalDevices(bool force = false);
-    static PhysicalDevice& pickDevice(bool force = false);
+    // FirstDiscrete : the first discrete GPU, else the first integrated one, else the first.
+    // Scored and Benchmarked : the best DeviceScorer score, without and with its benchmark.
+    enum class Selection { FirstDiscrete, Scored, Benchmarked };
+
+    // The devices of the last enumeration, `force` enumerating again.
+    static const std::vector<PhysicalDevice*>& getPhysicalDevices(bool force = false);
+    static PhysicalDevice& pickDevice(bool force = false,
+                                      Selection selection = Selection::FirstDiscrete);
+
+    // Probes every device up front, one thread per device when `parallel`.
+    static void probeAll(bool parallel = true);
 
     std::string getName() const {
         return _deviceProperties.deviceName;
@@ -120,79 +207,221 @@ public:
         return _handle;
     }
 
+    const VkPhysicalDeviceProperties& getProperties() const {
+        return _deviceProperties;
+    }
+
+    // Version usable with this device : the lowest of the instance and device versions.
+    uint32_t getApiVersion() const {
+        return std::min(VulkanContext::getInstance().getApiVersion(), _deviceProperties.apiVersion);
+    }
+
+    const VkPhysicalDeviceFeatures& getFeatures() const {
+        return probe().features;
+    }
+
+    // Only queried when getApiVersion() is at least 1.2, left zeroed otherwise.
+    const VkPhysicalDeviceVulkan12Features& getVulkan12Features() const {
+        return probe().vulkan12Features;
+    }
+
+    const VkPhysicalDeviceVulkan12Properties& getVulkan12Properties() const {
+        return probe().vulkan12Properties;
+    }
+
     uint32_t getBestGraphicsFamilyIndex() const {
-        std::vector<int> score(_deviceQueueFamilyProperties.size());
-        for (size_t i = 0; i < _deviceQueueFamilyProperties.size(); i++) {
-            if (_deviceQueueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                score[i] += 3 * _deviceQueueFamilyProperties[i].queueCount;
+        auto& families = getQueueFamilyProperties();
+        std::vector<int> score(families.size());
+        for (size_t i = 0; i < families.size(); i++) {
+            if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                score[i] += 3 * families[i].queueCount;
             }
-            if (_deviceQueueFamilyProperties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) {
-                score[i] -= _deviceQueueFamilyProperties[i].queueCount;
+            if (families[i].queueFlags & VK_QUEUE_TRANSFER_BIT) {
+                score[i] -= families[i].queueCount;
             }
-            if (_deviceQueueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-                score[i] -= _deviceQueueFamilyProperties[i].queueCount;
+            if (families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+                score[i] -= families[i].queueCount;
             }
         }
         return std::distance(score.begin(), std::max_element(score.begin(), score.end()));
     }
 
+    // Family able to copy but neither to draw nor to dispatch, i.e. backed by a DMA engine.
+    std::optional<uint32_t> getDedicatedTransferFamilyIndex() const {
+        return findFamilyIndex(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    }
+
+    // Compute family that does not share its queues with graphics work.
+    std::optional<uint32_t> getAsyncComputeFamilyIndex() const {
+        return findFamilyIndex(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+    }
+
+    const std::vector<VkQueueFamilyProperties>& getQueueFamilyProperties() const {
+        return probe().queueFamilies;
+    }
+
+    const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const {
+        return probe().memoryProperties;
+    }
+
+    bool isExtensionSupported(const char* name) const {
+        for (auto& extension : probe().extensions) {
+            if (strcmp(extension.extensionName, name) == 0) return true;
+        }
+        return false;
+    }
+
 private:
+    struct Probe {
+        std::once_flag once;
+        VkPhysicalDeviceFeatures features{};
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        VkPhysicalDeviceVulkan12Properties vulkan12Properties{};
+        std::vector<VkExtensionProperties> extensions;
+        std::vector<VkQueueFamilyProperties> queueFamilies;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+    };
+
     VkPhysicalDevice _handle;
     VkPhysicalDeviceProperties _deviceProperties;
-    VkPhysicalDeviceFeatures _deviceFeatures;
-    std::vector<VkQueueFamilyProperties> _deviceQueueFamilyProperties;
-    PhysicalDevice(const VkPhysicalDevice& handle) {
-        _handle = handle;
+    // Shared by the copies of the device, so a probe is never repeated.
+    std::shared_ptr<Probe> _probe;
+
+    // Thread safe, the first caller queries and the others wait for it.
+    const Probe& probe() const;
+
+    std::optional<uint32_t> findFamilyIndex(VkQueueFlags required, VkQueueFlags excluded) const {
+        auto& families = getQueueFamilyProperties();
+        std::optional<uint32_t> best;
+        for (uint32_t i = 0; i < families.size(); i++) {
+            auto& properties = families[i];
+            if ((properties.queueFlags & required) != required) continue;
+            if (properties.queueFlags & excluded) continue;
+            if (!best || properties.queueCount > families[*best].queueCount) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    PhysicalDevice(const VkPhysicalDevice& handle)
+        : _handle(handle), _probe(std::make_shared<Probe>()) {
         vkGetPhysicalDeviceProperties(_handle, &_deviceProperties);
         std::cout << _deviceProperties << '\n';
-        vkGetPhysicalDeviceFeatures(_handle, &_deviceFeatures);
-        uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(_handle, &queueFamilyCount, nullptr);
-        _deviceQueueFamilyProperties = std::vector<VkQueueFamilyProperties>(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(_handle, &queueFamilyCount,
-                                                 _deviceQueueFamilyProperties.data());
-        int i = 0;
-        for (auto& queueFamilyProperty : _deviceQueueFamilyProperties) {
-            std::cout << "Queue family " << ++i << "\n" << queueFamilyProperty;
-        }
     };
 };
 
 class LogicalDevice {
 public:
-    LogicalDevice(PhysicalDevice& physicalDevice) {
-        VkDeviceQueueCreateInfo queueCreateInfo{};
-        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfo.queueFamilyIndex = physicalDevice.getBestGraphicsFamilyIndex();
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &_queuePriority;
-
-        VkPhysicalDeviceFeatures deviceFeatures{};
-        VkDeviceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        createInfo.pQueueCreateInfos = &queueCreateInfo;
-        createInfo.queueCreateInfoCount = 1;
-        createInfo.pEnabledFeatures = &deviceFeatures;
-
-        createInfo.enabledExtensionCount = 0;
-
-        auto& context = VulkanContext::getInstance();
-        if (context.enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(context.validationLayers.size());
-            createInfo.ppEnabledLayerNames = context.validationLayers.data();
-        } else {
-            createInfo.enabledLayerCount = 0;
-        }
-        if (vkCreateDevice(physicalDevice.getHandle(), &createInfo, nullptr, &_handle) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create logical device!");
-        }
-    }
+    static constexpr uint32_t maxFramesInFlight = 3;
+
+    LogicalDevice(PhysicalDevice& physicalDevice, const std::string& pipelineCachePath = "");
     ~LogicalDevice() {
+        release();
         std::cout << "Destroyed logical device.\n";
-        vkDestroyDevice(_handle, nullptr);
+    }
+
+    LogicalDevice(LogicalDevice const&) = delete;
+    void operator=(LogicalDevice const&) = delete;
+
+    VkDevice getHandle() const {
+        return _handle;
+    }
+
+    PhysicalDevice& getPhysicalDevice() const {
+        return _physicalDevice;
+    }
+
+    Allocator& getAllocator() {
+        return *_allocator;
+    }
+
+    // Custom pools by resource lifetime, next to the default pools of getAllocator().
+    MemoryPools& getMemoryPools() {
+        return *_memoryPools;
+    }
+
+    PipelineCache& getPipelineCache() {
+        return *_pipelineCache;
+    }
+
+    // Timeline semaphores are enabled whenever the device supports them.
+    bool hasTimelineSemaphores() const {
+        return _timelineSemaphores;
+    }
+
+    // Same for host query reset (vkResetQueryPool).
+    bool hasHostQueryReset() const {
+        return _hostQueryReset;
+    }
+
+    bool isExtensionEnabled(const char* name) const {
+        for (auto enabled : _extensions) {
+            if (strcmp(enabled, name) == 0) return true;
+        }
+        return false;
+    }
+
+    // Null when the device lacks descriptor indexing : fall back to per-draw descriptor sets.
+    BindlessTable* getBindlessTable() {
+        return _bindlessTable.get();
+    }
+
+    LayoutCache& getLayoutCache() {
+        return *_layoutCache;
+    }
+
+    Profiler& getProfiler() {
+        return *_profiler;
+    }
+
+    BudgetMonitor& getBudgetMonitor() {
+        return *_budgetMonitor;
+    }
+
+    // Covers the default pools and the general pools of getMemoryPools().
+    Defragmenter& getDefragmenter() {
+        return *_defragmenter;
+    }
+
+    Queue& getQueue(QueueRole role) {
+        return *_roleQueues[static_cast<size_t>(role)];
+    }
+
+    CommandPoolManager& getCommandPools(QueueRole role) {
+        return *_commandPools[static_cast<size_t>(role)];
     }
 
 private:
     VkDevice _handle;
-    float _queuePriority = 1.0f;
+    PhysicalDevice& _physicalDevice;
+    bool _timelineSemaphores = false;
+    bool _hostQueryReset = false;
+    std::vector<const char*> _extensions;
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::array<Queue*, queueRoleCount> _roleQueues = {};
+    std::array<std::unique_ptr<CommandPoolManager>, queueRoleCount> _commandPools;
+    std::unique_ptr<Allocator> _allocator;
+    std::unique_ptr<MemoryPools> _memoryPools;
+    std::unique_ptr<PipelineCache> _pipelineCache;
+    std::unique_ptr<Profiler> _profiler;
+    std::unique_ptr<BudgetMonitor> _budgetMonitor;
+    std::unique_ptr<BindlessTable> _bindlessTable;
+    std::unique_ptr<LayoutCache> _layoutCache;
+    std::unique_ptr<Defragmenter> _defragmenter;
+
+    // Members in dependency order, then the device. Also undoes a constructor that threw after
+    // creating the device.
+    void release() {
+        _defragmenter.reset();
+        for (auto& commandPools : _commandPools) commandPools.reset();
+        _budgetMonitor.reset();
+        _profiler.reset();
+        _bindlessTable.reset();
+        _layoutCache.reset();
+        _pipelineCache.reset();
+        _memoryPools.reset();
+        _allocator.reset();
+        vkDestroyDevice(_handle, nullptr);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "bindless_table.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+static const VkDescriptorType descriptorTypes[] = {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                                                   VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                   VK_DESCRIPTOR_TYPE_SAMPLER};
+
+bool BindlessTable::isSupported(const VkPhysicalDeviceVulkan12Features& features) {
+    return features.descriptorIndexing && features.runtimeDescriptorArray &&
+           features.descriptorBindingPartiallyBound &&
+           features.descriptorBindingUpdateUnusedWhilePending &&
+           features.descriptorBindingSampledImageUpdateAfterBind &&
+           features.descriptorBindingStorageBufferUpdateAfterBind &&
+           features.shaderSampledImageArrayNonUniformIndexing &&
+           features.shaderStorageBufferArrayNonUniformIndexing;
+}
+
+BindlessTable::BindlessTable(VkDevice device, const VkPhysicalDeviceVulkan12Properties& properties,
+                             uint32_t framesInFlight, uint32_t maxImages /* = 65536 */,
+                             uint32_t maxBuffers /* = 65536 */, uint32_t maxSamplers /* = 256 */)
+    : _device(device), _retired(framesInFlight) {
+    // Per-stage limits bound what a single shader can see.
+    _slots[0].capacity =
+        std::min({maxImages, properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                  properties.maxPerStageDescriptorUpdateAfterBindSampledImages});
+    _slots[1].capacity =
+        std::min({maxBuffers, properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                  properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+    _slots[2].capacity =
+        std::min({maxSamplers, properties.maxDescriptorSetUpdateAfterBindSamplers,
+                  properties.maxPerStageDescriptorUpdateAfterBindSamplers});
+    // Every binding is visible to every stage, so all of them count against the per-stage
+    // total : samplers are kept, images and buffers share the rest in proportion. Every slot
+    // keeps at least one descriptor, empty bindings and pool sizes being invalid.
+    uint32_t total = std::max(3u, std::min(properties.maxPerStageUpdateAfterBindResources,
+                                           properties.maxUpdateAfterBindDescriptorsInAllPools));
+    for (auto& slot : _slots) slot.capacity = std::max(slot.capacity, 1u);
+    uint64_t resources = uint64_t(_slots[0].capacity) + _slots[1].capacity;
+    _slots[2].capacity = std::min(_slots[2].capacity, total - 2);
+    if (resources + _slots[2].capacity > total) {
+        uint32_t left = total - _slots[2].capacity;
+        _slots[0].capacity = static_cast<uint32_t>(_slots[0].capacity * uint64_t(left) / resources);
+        _slots[0].capacity = std::clamp(_slots[0].capacity, 1u, left - 1);
+        _slots[1].capacity = left - _slots[0].capacity;
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    std::array<VkDescriptorBindingFlags, 3> bindingFlags{};
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    for (uint32_t i = 0; i < 3; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = descriptorTypes[i];
+        bindings[i].descriptorCount = _slots[i].capacity;
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+        bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                          VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        poolSizes[i] = {descriptorTypes[i], _slots[i].capacity};
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+    flagsInfo.pBindingFlags = bindingFlags.data();
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &flagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create bindless descriptor set layout.");
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_pool) != VK_SUCCESS) {
+        vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+        throw std::runtime_error("Failed to create bindless descriptor pool.");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_layout;
+    if (vkAllocateDescriptorSets(_device, &allocInfo, &_set) != VK_SUCCESS) {
+        vkDestroyDescriptorPool(_device, _pool, nullptr);
+        vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+        throw std::runtime_error("Failed to allocate bindless descriptor set.");
+    }
+    std::cerr << "Bindless table successfully created (" << _slots[0].capacity << " images, "
+              << _slots[1].capacity << " buffers, " << _slots[2].capacity << " samplers).\n";
+}
+
+BindlessTable::~BindlessTable() {
+    vkDestroyDescriptorPool(_device, _pool, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+}
+
+uint32_t BindlessTable::addImage(VkImageView view,
+                                 VkImageLayout layout /* = SHADER_READ_ONLY_OPTIMAL */) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t handle = acquire(Kind::SampledImage);
+    VkDescriptorImageInfo imageInfo{VK_NULL_HANDLE, view, layout};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _set;
+    write.dstBinding = 0;
+    write.dstArrayElement = handle;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    return handle;
+}
+
+uint32_t BindlessTable::addBuffer(VkBuffer buffer, VkDeviceSize offset /* = 0 */,
+                                  VkDeviceSize range /* = VK_WHOLE_SIZE */) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t handle = acquire(Kind::StorageBuffer);
+    VkDescriptorBufferInfo bufferInfo{buffer, offset, range};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _set;
+    write.dstBinding = 1;
+    write.dstArrayElement = handle;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    return handle;
+}
+
+uint32_t BindlessTable::addSampler(VkSampler sampler) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t handle = acquire(Kind::Sampler);
+    VkDescriptorImageInfo imageInfo{sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _set;
+    write.dstBinding = 2;
+    write.dstArrayElement = handle;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+    return handle;
+}
+
+void BindlessTable::remove(Kind kind, uint32_t handle) {
+    if (handle == invalidHandle) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _retired[_frameIndex].push_back({kind, handle});
+}
+
+void BindlessTable::beginFrame(uint32_t frameIndex) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frameIndex = frameIndex % _retired.size();
+    for (auto& retired : _retired[_frameIndex]) {
+        _slots[static_cast<size_t>(retired.kind)].free.push_back(retired.handle);
+    }
+    _retired[_frameIndex].clear();
+}
+
+uint32_t BindlessTable::acquire(Kind kind) {
+    auto& slots = _slots[static_cast<size_t>(kind)];
+    if (!slots.free.empty()) {
+        uint32_t handle = slots.free.back();
+        slots.free.pop_back();
+        return handle;
+    }
+    if (slots.next == slots.capacity) throw std::runtime_error("Bindless table is full.");
+    return slots.next++;
+}
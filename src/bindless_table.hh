@@ -0,0 +1,85 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <mutex>
+#include <vector>
+
+// One update-after-bind descriptor set holding every sampled image, storage buffer and
+// sampler, addressed by 32-bit handles that shaders use as array indices :
+//
+//   layout(set = N, binding = 0) uniform texture2D images[];
+//   layout(set = N, binding = 1) buffer Buffers { uint data[]; } buffers[];
+//   layout(set = N, binding = 2) uniform sampler samplers[];
+//
+// Bound once per command buffer, so draws only pass handles (push constants, instance data).
+// Removed handles are reused only once the frames that may still read them have completed.
+class BindlessTable {
+public:
+    enum class Kind { SampledImage, StorageBuffer, Sampler };
+    static constexpr uint32_t invalidHandle = ~0u;
+
+    // Whether the descriptor indexing features the table relies on are all supported.
+    static bool isSupported(const VkPhysicalDeviceVulkan12Features& features);
+
+    // Capacities are clamped to the update-after-bind limits of the device.
+    BindlessTable(VkDevice device, const VkPhysicalDeviceVulkan12Properties& properties,
+                  uint32_t framesInFlight, uint32_t maxImages = 65536,
+                  uint32_t maxBuffers = 65536, uint32_t maxSamplers = 256);
+    ~BindlessTable();
+
+    BindlessTable(BindlessTable const&) = delete;
+    void operator=(BindlessTable const&) = delete;
+
+    uint32_t addImage(VkImageView view,
+                      VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset = 0,
+                       VkDeviceSize range = VK_WHOLE_SIZE);
+    uint32_t addSampler(VkSampler sampler);
+    void remove(Kind kind, uint32_t handle);
+
+    // Recycles the handles removed while frame i was last recorded. Runs once the GPU is done
+    // with frame i.
+    void beginFrame(uint32_t frameIndex);
+
+    void bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout layout,
+              uint32_t setIndex) const {
+        vkCmdBindDescriptorSets(cmd, bindPoint, layout, setIndex, 1, &_set, 0, nullptr);
+    }
+
+    VkDescriptorSetLayout getLayout() const {
+        return _layout;
+    }
+
+    VkDescriptorSet getSet() const {
+        return _set;
+    }
+
+    uint32_t getCapacity(Kind kind) const {
+        return _slots[static_cast<size_t>(kind)].capacity;
+    }
+
+private:
+    struct Slots {
+        uint32_t capacity = 0;
+        uint32_t next = 0;
+        std::vector<uint32_t> free;
+    };
+    struct Retired {
+        Kind kind;
+        uint32_t handle;
+    };
+
+    VkDevice _device;
+    VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+    VkDescriptorPool _pool = VK_NULL_HANDLE;
+    VkDescriptorSet _set = VK_NULL_HANDLE;
+    std::array<Slots, 3> _slots;
+    std::vector<std::vector<Retired>> _retired;
+    uint32_t _frameIndex = 0;
+    std::mutex _mutex;
+
+    uint32_t acquire(Kind kind);
+};
@@ -0,0 +1,197 @@
+#include "budget_monitor.hh"
+
+#include <algorithm>
+#include <string>
+
+static constexpr double mebibyte = 1024.0 * 1024.0;
+
+static const char* levelName(BudgetMonitor::Level level) {
+    switch (level) {
+        case BudgetMonitor::Level::Normal: return "normal";
+        case BudgetMonitor::Level::Warning: return "warning";
+        case BudgetMonitor::Level::Critical: return "critical";
+    }
+    return "unknown";
+}
+
+BudgetMonitor::BudgetMonitor(Allocator& allocator, bool budgetExtension,
+                             Profiler* profiler /* = nullptr */,
+                             Watermarks watermarks /* = {0.80, 0.95} */)
+    : _allocator(allocator),
+      _budgetExtension(budgetExtension),
+      _profiler(profiler),
+      _watermarks(watermarks) {
+    const VkPhysicalDeviceMemoryProperties* properties;
+    vmaGetMemoryProperties(_allocator.getHandle(), &properties);
+    _heaps.resize(properties->memoryHeapCount);
+    for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+        _heaps[i].heap = i;
+        _heaps[i].flags = properties->memoryHeaps[i].flags;
+    }
+    for (uint32_t i = 0; i < properties->memoryTypeCount; i++) {
+        _typeHeaps.push_back(properties->memoryTypes[i].heapIndex);
+    }
+    refresh();
+    _allocator.setOutOfMemoryHandler(
+        [this](const VkMemoryRequirements& requirements) { return makeRoom(requirements); });
+    std::cerr << "Budget monitor successfully created (" << _heaps.size() << " heaps, "
+              << (_budgetExtension ? "VK_EXT_memory_budget" : "estimated budgets") << ").\n";
+}
+
+BudgetMonitor::~BudgetMonitor() {
+    _allocator.setOutOfMemoryHandler(nullptr);
+}
+
+void BudgetMonitor::setWatermarks(Watermarks watermarks) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _watermarks = watermarks;
+    }
+    refresh();
+}
+
+BudgetMonitor::Watermarks BudgetMonitor::getWatermarks() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _watermarks;
+}
+
+uint32_t BudgetMonitor::addLevelCallback(LevelCallback callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t id = _nextId++;
+    _callbacks[id] = std::move(callback);
+    return id;
+}
+
+uint32_t BudgetMonitor::addEvictor(Evictor evictor, int cost /* = 0 */) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t id = _nextId++;
+    auto position = std::upper_bound(
+        _evictors.begin(), _evictors.end(), cost,
+        [](int cost, const EvictorEntry& entry) { return cost < entry.cost; });
+    _evictors.insert(position, {id, cost, std::move(evictor)});
+    return id;
+}
+
+void BudgetMonitor::remove(uint32_t id) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _callbacks.erase(id);
+    _evictors.erase(std::remove_if(_evictors.begin(), _evictors.end(),
+                                   [id](const EvictorEntry& entry) { return entry.id == id; }),
+                    _evictors.end());
+}
+
+void BudgetMonitor::update(uint64_t frame) {
+    // Lets VMA fetch the driver's numbers again, it otherwise only does every 30 allocations.
+    vmaSetCurrentFrameIndex(_allocator.getHandle(), static_cast<uint32_t>(frame));
+    refresh();
+
+    bool evicted = false;
+    for (auto& heap : getHeapBudgets()) {
+        if (heap.level == Level::Critical) evicted |= evict(heap.heap, getExcess(heap, 0)) > 0;
+    }
+    if (evicted) refresh();
+    if (_profiler && _profiler->isCapturing()) publish();
+}
+
+bool BudgetMonitor::makeRoom(const VkMemoryRequirements& requirements) {
+    std::vector<bool> candidates(_heaps.size(), false);
+    for (uint32_t type = 0; type < _typeHeaps.size(); type++) {
+        if (requirements.memoryTypeBits & (1u << type)) candidates[_typeHeaps[type]] = true;
+    }
+    refresh();
+    bool evicted = false;
+    for (auto& heap : getHeapBudgets()) {
+        if (!candidates[heap.heap]) continue;
+        VkDeviceSize excess = getExcess(heap, requirements.size);
+        if (excess > 0) evicted |= evict(heap.heap, excess) > 0;
+    }
+    if (evicted) refresh();
+    return evicted;
+}
+
+std::vector<BudgetMonitor::HeapBudget> BudgetMonitor::getHeapBudgets() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _heaps;
+}
+
+BudgetMonitor::Statistics BudgetMonitor::getStatistics() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _statistics;
+}
+
+void BudgetMonitor::refresh() {
+    auto budgets = _allocator.getHeapBudgets();
+    std::vector<HeapBudget> changed;
+    std::vector<LevelCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& heap : _heaps) {
+            auto& budget = budgets[heap.heap];
+            heap.usage = budget.usage;
+            heap.budget = budget.budget;
+            heap.blockBytes = budget.statistics.blockBytes;
+            heap.allocationBytes = budget.statistics.allocationBytes;
+            Level level = getLevel(heap.usage, heap.budget);
+            if (level == heap.level) continue;
+            heap.level = level;
+            changed.push_back(heap);
+            _statistics.levelChanges++;
+        }
+        if (changed.empty()) return;
+        for (auto& callback : _callbacks) callbacks.push_back(callback.second);
+    }
+    for (auto& heap : changed) {
+        std::cerr << "Memory heap " << heap.heap << " : " << heap.usage / mebibyte << " MiB of "
+                  << heap.budget / mebibyte << " MiB budget, " << levelName(heap.level)
+                  << " level.\n";
+        for (auto& callback : callbacks) callback(heap);
+    }
+}
+
+BudgetMonitor::Level BudgetMonitor::getLevel(VkDeviceSize usage, VkDeviceSize budget) const {
+    if (budget == 0) return Level::Normal;
+    double ratio = double(usage) / double(budget);
+    if (ratio >= _watermarks.critical) return Level::Critical;
+    if (ratio >= _watermarks.warning) return Level::Warning;
+    return Level::Normal;
+}
+
+VkDeviceSize BudgetMonitor::getExcess(const HeapBudget& heap, VkDeviceSize extra) const {
+    auto limit = static_cast<VkDeviceSize>(getWatermarks().warning * double(heap.budget));
+    return heap.usage + extra > limit ? heap.usage + extra - limit : 0;
+}
+
+VkDeviceSize BudgetMonitor::evict(uint32_t heap, VkDeviceSize bytes) {
+    std::vector<Evictor> evictors;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& entry : _evictors) evictors.push_back(entry.evictor);
+    }
+    VkDeviceSize released = 0;
+    uint64_t calls = 0;
+    for (auto& evictor : evictors) {
+        if (released >= bytes) break;
+        released += evictor(heap, bytes - released);
+        calls++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _statistics.evictorCalls += calls;
+        _statistics.evictedBytes += released;
+    }
+    if (calls > 0) {
+        std::cerr << "Evicted " << released / mebibyte << " MiB of the " << bytes / mebibyte
+                  << " MiB asked from memory heap " << heap << ".\n";
+    }
+    return released;
+}
+
+void BudgetMonitor::publish() const {
+    for (auto& heap : getHeapBudgets()) {
+        std::string name = "memory heap " + std::to_string(heap.heap);
+        if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) name += " (device local)";
+        _profiler->addCounter(name, {{"usage MiB", heap.usage / mebibyte},
+                                     {"budget MiB", heap.budget / mebibyte},
+                                     {"allocated MiB", heap.allocationBytes / mebibyte}});
+    }
+}
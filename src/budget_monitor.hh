@@ -0,0 +1,114 @@
+#pragma once
+
+#include "allocator.hh"
+#include "profiler.hh"
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Usage and budget of every memory heap, refreshed once per frame : from VK_EXT_memory_budget
+// when the device has it, else VMA's own allocations against 80% of the heap size. A heap
+// crossing a watermark, either way, raises the level callbacks. Past the critical watermark,
+// the evictors registered by owners of memory that can be dropped and recreated (streaming
+// textures, transient pools) are asked, cheapest first, to release enough to get back under
+// the warning one. An allocation failing for lack of memory does the same, on the heaps its
+// memory types are in, before its retry; allocations from custom pools are not retried. The
+// LogicalDevice registers the evictors of its transient arena and streaming cache.
+//
+// Usage and budget of each heap are published as counters of the profiler's trace, while it
+// captures.
+class BudgetMonitor {
+public:
+    enum class Level { Normal, Warning, Critical };
+
+    // Fractions of the budget.
+    struct Watermarks {
+        double warning;
+        double critical;
+    };
+    struct HeapBudget {
+        uint32_t heap = 0;
+        VkMemoryHeapFlags flags = 0;
+        VkDeviceSize usage = 0;
+        VkDeviceSize budget = 0;
+        // VMA's part of the usage : its memory blocks, and the allocations inside them.
+        VkDeviceSize blockBytes = 0;
+        VkDeviceSize allocationBytes = 0;
+        Level level = Level::Normal;
+    };
+    struct Statistics {
+        uint64_t levelChanges = 0;
+        uint64_t evictorCalls = 0;
+        VkDeviceSize evictedBytes = 0;
+    };
+
+    using LevelCallback = std::function<void(const HeapBudget&)>;
+    // Releases up to `bytes` from `heap` and returns how much it released. Only memory the GPU
+    // is done with may go : resources of the frames in flight must be kept.
+    using Evictor = std::function<VkDeviceSize(uint32_t heap, VkDeviceSize bytes)>;
+
+    BudgetMonitor(Allocator& allocator, bool budgetExtension, Profiler* profiler = nullptr,
+                  Watermarks watermarks = {0.80, 0.95});
+    ~BudgetMonitor();
+
+    BudgetMonitor(BudgetMonitor const&) = delete;
+    void operator=(BudgetMonitor const&) = delete;
+
+    void setWatermarks(Watermarks watermarks);
+    Watermarks getWatermarks() const;
+
+    // Both return an id for remove(). Evictors with a lower cost are asked first. Callbacks
+    // and evictors run without any lock held, on the thread calling update() or on the one
+    // whose allocation failed.
+    uint32_t addLevelCallback(LevelCallback callback);
+    uint32_t addEvictor(Evictor evictor, int cost = 0);
+    void remove(uint32_t id);
+
+    // Once per frame, with the frame number.
+    void update(uint64_t frame);
+
+    // Evicts from every heap holding one of requirements.memoryTypeBits where
+    // requirements.size more wouldn't fit under the warning watermark. Returns whether
+    // anything was released.
+    bool makeRoom(const VkMemoryRequirements& requirements);
+
+    std::vector<HeapBudget> getHeapBudgets() const;
+
+    // Without the extension, usage ignores other processes and non-VMA allocations.
+    bool hasBudgetExtension() const {
+        return _budgetExtension;
+    }
+
+    Statistics getStatistics() const;
+
+private:
+    struct EvictorEntry {
+        uint32_t id;
+        int cost;
+        Evictor evictor;
+    };
+
+    Allocator& _allocator;
+    bool _budgetExtension;
+    Profiler* _profiler;
+    // Heap of every memory type.
+    std::vector<uint32_t> _typeHeaps;
+
+    mutable std::mutex _mutex;
+    Watermarks _watermarks;
+    std::vector<HeapBudget> _heaps;
+    std::map<uint32_t, LevelCallback> _callbacks;
+    std::vector<EvictorEntry> _evictors;
+    uint32_t _nextId = 1;
+    Statistics _statistics;
+
+    // Queries the budgets again and raises the callbacks of the heaps whose level changed.
+    void refresh();
+    Level getLevel(VkDeviceSize usage, VkDeviceSize budget) const;
+    // Bytes to release for `extra` more to fit under the warning watermark.
+    VkDeviceSize getExcess(const HeapBudget& heap, VkDeviceSize extra) const;
+    VkDeviceSize evict(uint32_t heap, VkDeviceSize bytes);
+    void publish() const;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Hand-assembled SPIR-V 1.0 for:
+//   #version 450
+//   layout(local_size_x = 1) in;
+//   void main() {}
+inline const std::vector<uint32_t> emptyComputeShader = {
+    0x07230203, 0x00010000, 0x00000000, 0x00000005, 0x00000000,  // header, id bound 5
+    0x00020011, 0x00000001,                                      // OpCapability Shader
+    0x0003000e, 0x00000000, 0x00000001,                          // OpMemoryModel Logical GLSL450
+    0x0005000f, 0x00000005, 0x00000001, 0x6e69616d, 0x00000000,  // OpEntryPoint GLCompute %1 "main"
+    0x00060010, 0x00000001, 0x00000011, 0x00000001, 0x00000001, 0x00000001,  // LocalSize 1 1 1
+    0x00020013, 0x00000002,                                      // %2 = OpTypeVoid
+    0x00030021, 0x00000003, 0x00000002,                          // %3 = OpTypeFunction %2
+    0x00050036, 0x00000002, 0x00000001, 0x00000000, 0x00000003,  // %1 = OpFunction %2 None %3
+    0x000200f8, 0x00000004,                                      // %4 = OpLabel
+    0x000100fd,                                                  // OpReturn
+    0x00010038,                                                  // OpFunctionEnd
+};
@@ -0,0 +1,147 @@
+#include "command_pool.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// Pools of the calling thread by manager. Every thread's cache is registered, so a dying
+// manager can remove its entries from all of them; the cache's own lock is only contended then.
+struct ThreadPoolsCache {
+    std::mutex mutex;
+    std::vector<std::pair<const CommandPoolManager*, void*>> entries;
+
+    ThreadPoolsCache();
+    ~ThreadPoolsCache();
+};
+
+static std::mutex threadPoolsCachesMutex;
+static std::vector<ThreadPoolsCache*> threadPoolsCaches;
+static thread_local ThreadPoolsCache threadPoolsCache;
+
+ThreadPoolsCache::ThreadPoolsCache() {
+    std::lock_guard<std::mutex> lock(threadPoolsCachesMutex);
+    threadPoolsCaches.push_back(this);
+}
+
+ThreadPoolsCache::~ThreadPoolsCache() {
+    std::lock_guard<std::mutex> lock(threadPoolsCachesMutex);
+    threadPoolsCaches.erase(std::find(threadPoolsCaches.begin(), threadPoolsCaches.end(), this));
+}
+
+CommandPoolManager::CommandPoolManager(VkDevice device, uint32_t queueFamilyIndex,
+                                       uint32_t framesInFlight)
+    : _device(device),
+      _queueFamilyIndex(queueFamilyIndex),
+      _framesInFlight(framesInFlight) {
+}
+
+CommandPoolManager::~CommandPoolManager() {
+    {
+        std::lock_guard<std::mutex> lock(threadPoolsCachesMutex);
+        for (auto cache : threadPoolsCaches) {
+            std::lock_guard<std::mutex> cacheLock(cache->mutex);
+            auto& entries = cache->entries;
+            entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                         [this](const auto& entry) { return entry.first == this; }),
+                          entries.end());
+        }
+    }
+    for (auto& thread : _threads) {
+        for (auto& frame : thread->frames) vkDestroyCommandPool(_device, frame.pool, nullptr);
+    }
+}
+
+void CommandPoolManager::beginFrame(uint32_t frameIndex) {
+    frameIndex %= _framesInFlight;
+    {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        for (auto& thread : _threads) {
+            auto& frame = thread->frames[frameIndex];
+            if (frame.used[0] == 0 && frame.used[1] == 0) continue;
+            vkResetCommandPool(_device, frame.pool, 0);
+            frame.used[0] = frame.used[1] = 0;
+        }
+    }
+    _frameIndex.store(frameIndex, std::memory_order_release);
+}
+
+VkCommandBuffer CommandPoolManager::acquire(
+    VkCommandBufferLevel level /* = VK_COMMAND_BUFFER_LEVEL_PRIMARY */) {
+    auto& frame = local().frames[getFrameIndex()];
+    auto& buffers = frame.buffers[level];
+    auto& used = frame.used[level];
+    if (used == buffers.size()) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.pool;
+        allocInfo.level = level;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffer.");
+        }
+        buffers.push_back(commandBuffer);
+    }
+    return buffers[used++];
+}
+
+std::vector<VkCommandBuffer> CommandPoolManager::recordSecondary(
+    JobSystem& jobs, uint32_t count, const VkCommandBufferInheritanceInfo& inheritance,
+    const std::function<void(VkCommandBuffer, uint32_t)>& record) {
+    std::vector<VkCommandBuffer> commandBuffers(count);
+    jobs.parallelFor(0, count, [&](size_t i) {
+        VkCommandBuffer cmd = acquire(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (inheritance.renderPass != VK_NULL_HANDLE) {
+            beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        }
+        beginInfo.pInheritanceInfo = &inheritance;
+        if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin secondary command buffer.");
+        }
+        record(cmd, static_cast<uint32_t>(i));
+        if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record secondary command buffer.");
+        }
+        commandBuffers[i] = cmd;
+    }, 1);
+    return commandBuffers;
+}
+
+CommandPoolManager::ThreadPools& CommandPoolManager::local() {
+    {
+        std::lock_guard<std::mutex> lock(threadPoolsCache.mutex);
+        for (auto& entry : threadPoolsCache.entries) {
+            if (entry.first == this) return *static_cast<ThreadPools*>(entry.second);
+        }
+    }
+    auto& pools = registerThread();
+    std::lock_guard<std::mutex> lock(threadPoolsCache.mutex);
+    threadPoolsCache.entries.emplace_back(this, &pools);
+    return pools;
+}
+
+CommandPoolManager::ThreadPools& CommandPoolManager::registerThread() {
+    auto pools = std::make_unique<ThreadPools>();
+    pools->frames.resize(_framesInFlight);
+    for (auto& frame : pools->frames) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = _queueFamilyIndex;
+        if (vkCreateCommandPool(_device, &poolInfo, nullptr, &frame.pool) != VK_SUCCESS) {
+            for (auto& created : pools->frames) {
+                if (created.pool != VK_NULL_HANDLE) {
+                    vkDestroyCommandPool(_device, created.pool, nullptr);
+                }
+            }
+            throw std::runtime_error("Failed to create command pool.");
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_registryMutex);
+    _threads.push_back(std::move(pools));
+    return *_threads.back();
+}
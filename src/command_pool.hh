@@ -0,0 +1,70 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "job_system.hh"
+
+// Hands every recording thread its own VkCommandPool per frame in flight, so recording never
+// waits on another thread. Command buffers are never freed : beginFrame() resets the pools of a
+// frame as a whole and their buffers are handed out again by acquire().
+//
+// Contract : beginFrame(i) runs once the GPU is done with frame i and before any thread
+// records for it, and no thread records for a frame while it is being reset.
+class CommandPoolManager {
+public:
+    CommandPoolManager(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight);
+    ~CommandPoolManager();
+
+    CommandPoolManager(CommandPoolManager const&) = delete;
+    void operator=(CommandPoolManager const&) = delete;
+
+    void beginFrame(uint32_t frameIndex);
+
+    // Command buffer in the initial state from the calling thread's pool for the current frame.
+    VkCommandBuffer acquire(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    // Records `count` secondary command buffers on the job system workers, record(cmd, i)
+    // filling the i-th one. The result keeps index order, ready for vkCmdExecuteCommands.
+    std::vector<VkCommandBuffer> recordSecondary(
+        JobSystem& jobs, uint32_t count, const VkCommandBufferInheritanceInfo& inheritance,
+        const std::function<void(VkCommandBuffer, uint32_t)>& record);
+
+    uint32_t getFrameIndex() const {
+        return _frameIndex.load(std::memory_order_acquire);
+    }
+
+    uint32_t getFramesInFlight() const {
+        return _framesInFlight;
+    }
+
+    uint32_t getQueueFamilyIndex() const {
+        return _queueFamilyIndex;
+    }
+
+private:
+    struct FramePool {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> buffers[2];
+        size_t used[2] = {0, 0};
+    };
+    struct ThreadPools {
+        std::vector<FramePool> frames;
+    };
+
+    VkDevice _device;
+    uint32_t _queueFamilyIndex;
+    uint32_t _framesInFlight;
+    std::atomic<uint32_t> _frameIndex{0};
+    std::mutex _registryMutex;
+    std::vector<std::unique_ptr<ThreadPools>> _threads;
+
+    ThreadPools& local();
+    ThreadPools& registerThread();
+};
@@ -0,0 +1,492 @@
+#include "defragmenter.hh"
+
+#include "application.hh"
+
+static constexpr double mebibyte = 1024.0 * 1024.0;
+static constexpr VkBufferUsageFlags bufferTransferUsage =
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+static constexpr VkImageUsageFlags imageTransferUsage =
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+static VkImageAspectFlags getAspect(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+Defragmenter::Defragmenter(LogicalDevice& device,
+                           const DefragmentationSettings& settings /* = {} */)
+    : _device(device), _settings(settings), _queue(device.getQueue(QueueRole::Transfer)) {
+    VkDevice handle = _device.getHandle();
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = _queue.getFamilyIndex();
+    if (vkCreateCommandPool(handle, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create defragmentation command pool.");
+    }
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool = _commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(handle, &allocateInfo, &_commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate defragmentation command buffer.");
+    }
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(handle, &fenceInfo, nullptr, &_fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create defragmentation fence.");
+    }
+
+    // Query resets are recorded when the family allows it, done from the host otherwise.
+    auto& family =
+        _device.getPhysicalDevice().getQueueFamilyProperties()[_queue.getFamilyIndex()];
+    bool resettable = _device.hasHostQueryReset() ||
+                      (family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+    if (family.timestampValidBits > 0 && resettable) {
+        VkQueryPoolCreateInfo queryInfo{};
+        queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryInfo.queryCount = 2;
+        if (vkCreateQueryPool(handle, &queryInfo, nullptr, &_queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create defragmentation query pool.");
+        }
+        _timestampMask = family.timestampValidBits >= 64
+                             ? ~0ull
+                             : (1ull << family.timestampValidBits) - 1;
+    }
+    std::cerr << "Defragmenter successfully created ("
+              << (_queryPool ? "timed passes" : "fixed size passes") << ").\n";
+}
+
+Defragmenter::~Defragmenter() {
+    VkDevice handle = _device.getHandle();
+    if (_state != State::Idle) {
+        vkDeviceWaitIdle(handle);
+        if (_state == State::Copying) {
+            // Never swapped in : the new places are given up.
+            for (auto& move : _moves) {
+                if (move.buffer) vkDestroyBuffer(handle, move.buffer, nullptr);
+                if (move.image) vkDestroyImage(handle, move.image, nullptr);
+                if (move.buffer || move.image) {
+                    move.move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                }
+            }
+            _moves.clear();
+        }
+        if (_state != State::Ready) endPass();
+        if (_state != State::Idle) end();
+    }
+    if (_queryPool) vkDestroyQueryPool(handle, _queryPool, nullptr);
+    vkDestroyFence(handle, _fence, nullptr);
+    vkDestroyCommandPool(handle, _commandPool, nullptr);
+    std::cerr << "Destroyed defragmenter.\n";
+}
+
+void Defragmenter::track(Buffer& buffer, const VkBufferCreateInfo& createInfo,
+                         BufferMoved moved /* = {} */) {
+    if (buffer.getMappedData() != nullptr) {
+        throw std::runtime_error("Mapped buffers can't be defragmented.");
+    }
+    if ((createInfo.usage & bufferTransferUsage) != bufferTransferUsage) {
+        throw std::runtime_error("Defragmented buffers need transfer source and destination use.");
+    }
+    auto& tracked = _tracked[buffer.getAllocation()];
+    tracked = Tracked();
+    tracked.buffer = &buffer;
+    tracked.bufferInfo = createInfo;
+    tracked.bufferInfo.pNext = nullptr;
+    if (createInfo.pQueueFamilyIndices) {
+        tracked.queueFamilies.assign(createInfo.pQueueFamilyIndices,
+                                     createInfo.pQueueFamilyIndices +
+                                         createInfo.queueFamilyIndexCount);
+    }
+    tracked.bufferInfo.pQueueFamilyIndices = tracked.queueFamilies.data();
+    tracked.bufferMoved = std::move(moved);
+}
+
+void Defragmenter::track(Image& image, const VkImageCreateInfo& createInfo, VkImageLayout layout,
+                         ImageMoved moved /* = {} */) {
+    if (layout != VK_IMAGE_LAYOUT_GENERAL && layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        throw std::runtime_error("Defragmented images must be in GENERAL or TRANSFER_SRC layout.");
+    }
+    if ((createInfo.usage & imageTransferUsage) != imageTransferUsage) {
+        throw std::runtime_error("Defragmented images need transfer source and destination use.");
+    }
+    auto& tracked = _tracked[image.getAllocation()];
+    tracked = Tracked();
+    tracked.image = &image;
+    tracked.imageInfo = createInfo;
+    tracked.imageInfo.pNext = nullptr;
+    tracked.imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (createInfo.pQueueFamilyIndices) {
+        tracked.queueFamilies.assign(createInfo.pQueueFamilyIndices,
+                                     createInfo.pQueueFamilyIndices +
+                                         createInfo.queueFamilyIndexCount);
+    }
+    tracked.imageInfo.pQueueFamilyIndices = tracked.queueFamilies.data();
+    tracked.layout = layout;
+    tracked.imageMoved = std::move(moved);
+}
+
+void Defragmenter::untrack(Buffer& buffer) {
+    untrack(buffer.getAllocation());
+}
+
+void Defragmenter::untrack(Image& image) {
+    untrack(image.getAllocation());
+}
+
+void Defragmenter::addPool(MemoryPool& pool) {
+    if (pool.getPolicy() != MemoryPool::Policy::General) {
+        throw std::runtime_error("Only general memory pools can be defragmented.");
+    }
+    _pools.push_back(pool.getHandle());
+}
+
+void Defragmenter::update(uint64_t frame, uint64_t completedFrame) {
+    switch (_state) {
+        case State::Idle:
+            if (frame < _nextCheck || _tracked.empty()) return;
+            _nextCheck = frame + _settings.checkInterval;
+            begin();
+            if (_state == State::Ready) beginPass();
+            return;
+        case State::Ready:
+            beginPass();
+            return;
+        case State::Copying:
+            if (vkGetFenceStatus(_device.getHandle(), _fence) != VK_SUCCESS) return;
+            swapHandles(frame);
+            return;
+        case State::Retiring:
+            if (completedFrame >= _retireFrame) endPass();
+            return;
+    }
+}
+
+VkDeviceSize Defragmenter::getUnusedBytes(VmaPool pool) const {
+    VmaAllocator allocator = _device.getAllocator().getHandle();
+    VmaStatistics statistics{};
+    if (pool) {
+        vmaGetPoolStatistics(allocator, pool, &statistics);
+        return statistics.blockBytes - statistics.allocationBytes;
+    }
+    // The default pools : everything but the custom pools of the device.
+    VmaTotalStatistics totalStatistics{};
+    vmaCalculateStatistics(allocator, &totalStatistics);
+    auto& total = totalStatistics.total.statistics;
+    VkDeviceSize unused = total.blockBytes - total.allocationBytes;
+    auto& pools = _device.getMemoryPools();
+    for (MemoryPool* custom : {&pools.getTransient(), &pools.getStreaming(),
+                               &pools.getGeneralBuffers(), &pools.getGeneralImages()}) {
+        vmaGetPoolStatistics(allocator, custom->getHandle(), &statistics);
+        unused -= std::min(unused, statistics.blockBytes - statistics.allocationBytes);
+    }
+    return unused;
+}
+
+void Defragmenter::begin() {
+    VmaAllocator allocator = _device.getAllocator().getHandle();
+    VmaPool pool = VK_NULL_HANDLE;
+    VkDeviceSize unused = 0;
+    size_t candidates = _pools.size();
+    for (; candidates > 0; candidates--) {
+        pool = _pools[_nextPool];
+        _nextPool = (_nextPool + 1) % _pools.size();
+        unused = getUnusedBytes(pool);
+        if (unused >= _settings.minUnusedBytes) break;
+    }
+    if (candidates == 0) return;
+
+    // Pass sizes are fixed for the whole defragmentation, from the last measured speed. The
+    // first one measured ends the defragmentation, so that the next can use it.
+    VkDeviceSize passBytes = std::min(_settings.unmeasuredBytesPerPass, _settings.maxBytesPerPass);
+    _measuredPasses = _bytesPerMillisecond > 0.0;
+    if (_measuredPasses) {
+        auto budgetBytes =
+            static_cast<VkDeviceSize>(_bytesPerMillisecond * _settings.gpuMillisecondsPerFrame);
+        passBytes = std::clamp<VkDeviceSize>(budgetBytes, 64 * 1024, _settings.maxBytesPerPass);
+    }
+    VmaDefragmentationInfo info{};
+    info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    info.pool = pool;
+    info.maxBytesPerPass = passBytes;
+    info.maxAllocationsPerPass = _settings.maxAllocationsPerPass;
+    if (vmaBeginDefragmentation(allocator, &info, &_context) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin defragmentation.");
+    }
+    _state = State::Ready;
+    const char* poolName = nullptr;
+    if (pool) vmaGetPoolName(allocator, pool, &poolName);
+    std::cerr << "Defragmenting " << unused / mebibyte << " MiB of unused space in "
+              << (poolName ? poolName : "the default pools") << ", " << passBytes / mebibyte
+              << " MiB per pass.\n";
+}
+
+void Defragmenter::beginPass() {
+    VmaAllocator allocator = _device.getAllocator().getHandle();
+    if (vmaBeginDefragmentationPass(allocator, _context, &_pass) == VK_SUCCESS) {
+        end();
+        return;
+    }
+    recordMoves();
+    if (_moves.empty()) {
+        // Only untracked allocations : ending the pass gives their new places back, and the
+        // next passes would offer the same ones.
+        vmaEndDefragmentationPass(allocator, _context, &_pass);
+        end();
+        return;
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_commandBuffer;
+    vkResetFences(_device.getHandle(), 1, &_fence);
+    if (_queue.submit(1, &submitInfo, _fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit defragmentation copies.");
+    }
+    _state = State::Copying;
+    _statistics.passes++;
+}
+
+void Defragmenter::recordMoves() {
+    VkDevice device = _device.getHandle();
+    VmaAllocator allocator = _device.getAllocator().getHandle();
+    _moves.clear();
+    _passBytes = 0;
+
+    std::vector<VkImageMemoryBarrier> toTransfer;
+    for (uint32_t i = 0; i < _pass.moveCount; i++) {
+        auto& move = _pass.pMoves[i];
+        auto tracked = _tracked.find(move.srcAllocation);
+        if (tracked == _tracked.end()) {
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+        Move created{&move};
+        if (tracked->second.buffer) {
+            if (vkCreateBuffer(device, &tracked->second.bufferInfo, nullptr, &created.buffer) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Failed to create defragmented buffer.");
+            }
+            if (vmaBindBufferMemory(allocator, move.dstTmpAllocation, created.buffer) !=
+                VK_SUCCESS) {
+                vkDestroyBuffer(device, created.buffer, nullptr);
+                throw std::runtime_error("Failed to bind defragmented buffer.");
+            }
+        } else {
+            if (vkCreateImage(device, &tracked->second.imageInfo, nullptr, &created.image) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Failed to create defragmented image.");
+            }
+            if (vmaBindImageMemory(allocator, move.dstTmpAllocation, created.image) !=
+                VK_SUCCESS) {
+                vkDestroyImage(device, created.image, nullptr);
+                throw std::runtime_error("Failed to bind defragmented image.");
+            }
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = created.image;
+            barrier.subresourceRange = {getAspect(tracked->second.imageInfo.format), 0,
+                                        VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+            toTransfer.push_back(barrier);
+        }
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, move.srcAllocation, &info);
+        _passBytes += info.size;
+        _moves.push_back(created);
+    }
+    if (_moves.empty()) return;
+
+    VkCommandBuffer cmd = _commandBuffer;
+    vkResetCommandBuffer(cmd, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin defragmentation command buffer.");
+    }
+    if (_queryPool) {
+        if (_device.hasHostQueryReset()) {
+            vkResetQueryPool(device, _queryPool, 0, 2);
+        } else {
+            vkCmdResetQueryPool(cmd, _queryPool, 0, 2);
+        }
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, 0);
+    }
+    if (!toTransfer.empty()) {
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                             static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+    }
+
+    std::vector<VkImageMemoryBarrier> toFinal;
+    for (auto& move : _moves) {
+        auto& tracked = _tracked[move.move->srcAllocation];
+        if (move.buffer) {
+            VkBufferCopy region{0, 0, tracked.buffer->getSize()};
+            vkCmdCopyBuffer(cmd, tracked.buffer->getHandle(), move.buffer, 1, &region);
+            continue;
+        }
+        auto& imageInfo = tracked.imageInfo;
+        VkImageAspectFlags aspect = getAspect(imageInfo.format);
+        std::vector<VkImageCopy> regions;
+        for (uint32_t level = 0; level < imageInfo.mipLevels; level++) {
+            VkImageCopy region{};
+            region.srcSubresource = {aspect, level, 0, imageInfo.arrayLayers};
+            region.dstSubresource = region.srcSubresource;
+            region.extent = {std::max(1u, imageInfo.extent.width >> level),
+                             std::max(1u, imageInfo.extent.height >> level),
+                             std::max(1u, imageInfo.extent.depth >> level)};
+            regions.push_back(region);
+        }
+        vkCmdCopyImage(cmd, tracked.image->getHandle(), tracked.layout, move.image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       static_cast<uint32_t>(regions.size()), regions.data());
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = tracked.layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = move.image;
+        barrier.subresourceRange = {aspect, 0, VK_REMAINING_MIP_LEVELS, 0,
+                                    VK_REMAINING_ARRAY_LAYERS};
+        toFinal.push_back(barrier);
+    }
+    if (!toFinal.empty()) {
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+                             static_cast<uint32_t>(toFinal.size()), toFinal.data());
+    }
+    if (_queryPool) {
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _queryPool, 1);
+    }
+    if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record defragmentation command buffer.");
+    }
+}
+
+void Defragmenter::swapHandles(uint64_t frame) {
+    if (_queryPool) {
+        uint64_t timestamps[2] = {};
+        if (vkGetQueryPoolResults(_device.getHandle(), _queryPool, 0, 2, sizeof(timestamps),
+                                  timestamps, sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            uint64_t ticks = ((timestamps[1] & _timestampMask) - (timestamps[0] & _timestampMask)) &
+                             _timestampMask;
+            double period = _device.getPhysicalDevice().getProperties().limits.timestampPeriod;
+            double milliseconds = double(ticks) * period / 1e6;
+            _statistics.gpuMilliseconds += milliseconds;
+            double speed = double(_passBytes) / std::max(milliseconds, 1e-3);
+            _bytesPerMillisecond =
+                _bytesPerMillisecond > 0.0 ? 0.5 * _bytesPerMillisecond + 0.5 * speed : speed;
+        }
+    }
+
+    // From here on, moves hold the old handles.
+    for (auto& move : _moves) {
+        auto tracked = _tracked.find(move.move->srcAllocation);
+        if (tracked == _tracked.end()) continue;
+        if (move.buffer) {
+            Buffer& buffer = *tracked->second.buffer;
+            std::swap(buffer._handle, move.buffer);
+            if (tracked->second.bufferMoved) tracked->second.bufferMoved(buffer, move.buffer);
+        } else if (move.image) {
+            Image& image = *tracked->second.image;
+            std::swap(image._handle, move.image);
+            if (tracked->second.imageMoved) tracked->second.imageMoved(image, move.image);
+        }
+    }
+    // Frames up to the previous one were recorded with the old handles.
+    _retireFrame = frame > 0 ? frame - 1 : 0;
+    _state = State::Retiring;
+}
+
+void Defragmenter::endPass() {
+    VkDevice device = _device.getHandle();
+    for (auto& move : _moves) {
+        if (move.buffer) vkDestroyBuffer(device, move.buffer, nullptr);
+        if (move.image) vkDestroyImage(device, move.image, nullptr);
+    }
+    _moves.clear();
+    VkResult result =
+        vmaEndDefragmentationPass(_device.getAllocator().getHandle(), _context, &_pass);
+    if (result == VK_SUCCESS) {
+        end();
+    } else if (!_measuredPasses && _bytesPerMillisecond > 0.0) {
+        // Restarted on the next update, same pool, with passes sized from the measured speed.
+        end();
+        _nextCheck = 0;
+        _nextPool = (_nextPool + _pools.size() - 1) % _pools.size();
+    } else {
+        _state = State::Ready;
+    }
+}
+
+void Defragmenter::end() {
+    VmaDefragmentationStats statistics{};
+    vmaEndDefragmentation(_device.getAllocator().getHandle(), _context, &statistics);
+    _context = VK_NULL_HANDLE;
+    _state = State::Idle;
+    _statistics.defragmentations++;
+    _statistics.allocationsMoved += statistics.allocationsMoved;
+    _statistics.bytesMoved += statistics.bytesMoved;
+    _statistics.bytesFreed += statistics.bytesFreed;
+    _statistics.blocksFreed += statistics.deviceMemoryBlocksFreed;
+    std::cerr << "Defragmentation moved " << statistics.bytesMoved / mebibyte << " MiB ("
+              << statistics.allocationsMoved << " allocations), freed "
+              << statistics.bytesFreed / mebibyte << " MiB (" << statistics.deviceMemoryBlocksFreed
+              << " blocks).\n";
+}
+
+void Defragmenter::untrack(VmaAllocation allocation) {
+    auto tracked = _tracked.find(allocation);
+    if (tracked == _tracked.end()) return;
+    Move* move = findMove(allocation);
+    if (move) {
+        // The resource is being destroyed anyway : both its handles go now, its memory with
+        // the pass. The copy must be over first.
+        VkDevice device = _device.getHandle();
+        if (_state == State::Copying) vkWaitForFences(device, 1, &_fence, VK_TRUE, UINT64_MAX);
+        if (Buffer* buffer = tracked->second.buffer) {
+            vkDestroyBuffer(device, move->buffer, nullptr);
+            vkDestroyBuffer(device, buffer->_handle, nullptr);
+            buffer->_handle = VK_NULL_HANDLE;
+            buffer->_allocation = VK_NULL_HANDLE;
+        } else if (Image* image = tracked->second.image) {
+            vkDestroyImage(device, move->image, nullptr);
+            vkDestroyImage(device, image->_handle, nullptr);
+            image->_handle = VK_NULL_HANDLE;
+            image->_allocation = VK_NULL_HANDLE;
+        }
+        move->buffer = VK_NULL_HANDLE;
+        move->image = VK_NULL_HANDLE;
+        move->move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+    }
+    _tracked.erase(tracked);
+}
+
+Defragmenter::Move* Defragmenter::findMove(VmaAllocation allocation) {
+    for (auto& move : _moves) {
+        if (move.move->srcAllocation == allocation && (move.buffer || move.image)) return &move;
+    }
+    return nullptr;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "allocator.hh"
+#include "memory_pools.hh"
+#include "queue.hh"
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class LogicalDevice;
+
+struct DefragmentationSettings {
+    // GPU time the copies of a frame may take. Measured with timestamps when the transfer queue
+    // has them, passes stay at their unmeasured size otherwise.
+    double gpuMillisecondsPerFrame = 0.5;
+    VkDeviceSize maxBytesPerPass = 16ull << 20;
+    // Until a pass was timed : about what a slow transfer queue (1 GiB/s) copies within the
+    // default budget.
+    VkDeviceSize unmeasuredBytesPerPass = 512ull << 10;
+    uint32_t maxAllocationsPerPass = 64;
+    // A defragmentation starts when the memory blocks have this much unused space.
+    VkDeviceSize minUnusedBytes = 64ull << 20;
+    // Frames between two looks at the unused space.
+    uint32_t checkInterval = 120;
+};
+
+// Moves tracked buffers and images out of sparsely used memory blocks so that VMA can free
+// them, one bounded pass at a time. A pass copies to the new places on the transfer queue,
+// then swaps the handles of the resources and calls their move callbacks, which rewrite the
+// descriptors referring to the old handles. The old handles are destroyed, and the pass ended,
+// once the frames recorded before the swap completed. Untracked allocations never move.
+// Each defragmentation covers either the default pools or one of the pools added with
+// addPool(), in turn.
+//
+// Tracked resources must only be read by the GPU (static meshes, textures), must not move
+// in memory while tracked, and must be untracked before they are destroyed. When the transfer
+// queue has its own family, they must be created with VK_SHARING_MODE_CONCURRENT, as for the
+// StagingUploader. Images are copied in their current layout, GENERAL or
+// TRANSFER_SRC_OPTIMAL : a layout transition would race with the frames sampling them.
+class Defragmenter {
+public:
+    struct Statistics {
+        uint64_t defragmentations = 0;
+        uint64_t passes = 0;
+        uint64_t allocationsMoved = 0;
+        VkDeviceSize bytesMoved = 0;
+        // Memory blocks released to the driver.
+        VkDeviceSize bytesFreed = 0;
+        uint64_t blocksFreed = 0;
+        double gpuMilliseconds = 0.0;
+    };
+
+    // Called with the old handle once the resource has its new one. The old handle stays
+    // valid until the frames already recorded completed.
+    using BufferMoved = std::function<void(const Buffer& buffer, VkBuffer oldHandle)>;
+    using ImageMoved = std::function<void(const Image& image, VkImage oldHandle)>;
+
+    Defragmenter(LogicalDevice& device,
+                 const DefragmentationSettings& settings = DefragmentationSettings());
+    ~Defragmenter();
+
+    Defragmenter(Defragmenter const&) = delete;
+    void operator=(Defragmenter const&) = delete;
+
+    // createInfo describes the resource as created, pNext is ignored. Mapped buffers can't move.
+    void track(Buffer& buffer, const VkBufferCreateInfo& createInfo, BufferMoved moved = {});
+    void track(Image& image, const VkImageCreateInfo& createInfo, VkImageLayout layout,
+               ImageMoved moved = {});
+
+    // A resource being moved is released with the pass instead, leaving an empty wrapper.
+    void untrack(Buffer& buffer);
+    void untrack(Image& image);
+
+    // Only pools with the General policy : VMA can't defragment linear ones.
+    void addPool(MemoryPool& pool);
+
+    // Once per frame before recording, with the frame number (from 1) and the last completed
+    // frame (0 for none). FrameScheduler and OffscreenRenderer call it for the device's own.
+    void update(uint64_t frame, uint64_t completedFrame);
+
+    bool isRunning() const {
+        return _state != State::Idle;
+    }
+
+    Statistics getStatistics() const {
+        return _statistics;
+    }
+
+private:
+    enum class State { Idle, Ready, Copying, Retiring };
+
+    struct Tracked {
+        Buffer* buffer = nullptr;
+        Image* image = nullptr;
+        VkBufferCreateInfo bufferInfo{};
+        VkImageCreateInfo imageInfo{};
+        std::vector<uint32_t> queueFamilies;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        BufferMoved bufferMoved;
+        ImageMoved imageMoved;
+    };
+    // A copied allocation : its new handle until the swap, its old one after.
+    struct Move {
+        VmaDefragmentationMove* move;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkImage image = VK_NULL_HANDLE;
+    };
+
+    LogicalDevice& _device;
+    DefragmentationSettings _settings;
+    Queue& _queue;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer _commandBuffer = VK_NULL_HANDLE;
+    VkFence _fence = VK_NULL_HANDLE;
+    // Null without timestamps on the transfer queue.
+    VkQueryPool _queryPool = VK_NULL_HANDLE;
+    uint64_t _timestampMask = 0;
+
+    std::unordered_map<VmaAllocation, Tracked> _tracked;
+    // Defragmented in turn, null for the default pools.
+    std::vector<VmaPool> _pools = {VK_NULL_HANDLE};
+    size_t _nextPool = 0;
+    State _state = State::Idle;
+    VmaDefragmentationContext _context = VK_NULL_HANDLE;
+    VmaDefragmentationPassMoveInfo _pass{};
+    std::vector<Move> _moves;
+    VkDeviceSize _passBytes = 0;
+    uint64_t _retireFrame = 0;
+    uint64_t _nextCheck = 0;
+    // Measured copy speed, 0 until a pass was timed.
+    double _bytesPerMillisecond = 0.0;
+    // Whether the running defragmentation sized its passes from a measured speed.
+    bool _measuredPasses = false;
+    Statistics _statistics;
+
+    VkDeviceSize getUnusedBytes(VmaPool pool) const;
+    void begin();
+    void beginPass();
+    void recordMoves();
+    void swapHandles(uint64_t frame);
+    void endPass();
+    void end();
+    void untrack(VmaAllocation allocation);
+    Move* findMove(VmaAllocation allocation);
+};
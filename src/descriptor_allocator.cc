@@ -0,0 +1,131 @@
+#include "descriptor_allocator.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+const std::vector<DescriptorAllocator::PoolRatio> DescriptorAllocator::defaultRatios = {
+    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f}, {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},         {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f},
+    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f},          {VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+};
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device, uint32_t framesInFlight,
+                                         uint32_t setsPerPool /* = 256 */,
+                                         const std::vector<PoolRatio>& ratios /* = defaultRatios */)
+    : _device(device),
+      _frames(framesInFlight),
+      _setsPerPool(std::clamp(setsPerPool, 1u, maxSetsPerPool)) {
+    for (auto& ratio : ratios) _descriptorsPerSet[ratio.type] = ratio.descriptorsPerSet;
+}
+
+DescriptorAllocator::~DescriptorAllocator() {
+    for (auto& frame : _frames) {
+        for (auto pool : frame.pools) vkDestroyDescriptorPool(_device, pool, nullptr);
+    }
+}
+
+void DescriptorAllocator::beginFrame(uint32_t frameIndex) {
+    _frameIndex = frameIndex % _frames.size();
+    auto& frame = _frames[_frameIndex];
+    observe(frame);
+    if (frame.pools.size() > 1) {
+        // Outgrew its first pool : later pools are sized for what the frame really used.
+        for (auto pool : frame.pools) vkDestroyDescriptorPool(_device, pool, nullptr);
+        frame.pools.clear();
+        uint32_t needed = 1;
+        while (needed < frame.sets && needed < maxSetsPerPool) needed *= 2;
+        _setsPerPool = std::max(_setsPerPool, needed);
+    } else {
+        for (auto pool : frame.pools) vkResetDescriptorPool(_device, pool, 0);
+    }
+    frame.sets = 0;
+    frame.unregisteredSets = 0;
+    frame.descriptors.clear();
+}
+
+void DescriptorAllocator::registerLayout(
+    VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    auto& counts = _layouts[layout];
+    counts.clear();
+    for (auto& binding : bindings) counts[binding.descriptorType] += binding.descriptorCount;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout,
+                                              const void* pNext /* = nullptr */) {
+    auto& frame = _frames[_frameIndex];
+    if (frame.pools.empty()) frame.pools.push_back(createPool());
+    auto counts = _layouts.find(layout);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = pNext;
+    allocInfo.descriptorPool = frame.pools.back();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+    VkDescriptorSet set;
+    VkResult result = vkAllocateDescriptorSets(_device, &allocInfo, &set);
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        // Pools grow geometrically so a burst needs few of them.
+        // The failing set is counted in, so a type no pool reserved yet gets reserved now.
+        _statistics.grows++;
+        _setsPerPool = std::min(_setsPerPool * 2, maxSetsPerPool);
+        Frame withFailedSet;
+        withFailedSet.sets = frame.sets + 1;
+        withFailedSet.unregisteredSets = frame.unregisteredSets + (counts == _layouts.end());
+        withFailedSet.descriptors = frame.descriptors;
+        if (counts != _layouts.end()) {
+            for (auto& [type, count] : counts->second) withFailedSet.descriptors[type] += count;
+        }
+        observe(withFailedSet);
+        frame.pools.push_back(createPool());
+        allocInfo.descriptorPool = frame.pools.back();
+        result = vkAllocateDescriptorSets(_device, &allocInfo, &set);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set.");
+    }
+    frame.sets++;
+    if (counts != _layouts.end()) {
+        for (auto& [type, count] : counts->second) frame.descriptors[type] += count;
+    } else {
+        frame.unregisteredSets++;
+    }
+    _statistics.setsAllocated++;
+    return set;
+}
+
+void DescriptorAllocator::observe(const Frame& frame) {
+    if (frame.sets == 0) return;
+    // The guesses of the ratios go away once a frame told the whole story.
+    if (!_ratiosReplaced && frame.unregisteredSets == 0) {
+        _descriptorsPerSet.clear();
+        _ratiosReplaced = true;
+    }
+    for (auto& [type, count] : frame.descriptors) {
+        float perSet = float(count) / float(frame.sets);
+        _descriptorsPerSet[type] = std::max(_descriptorsPerSet[type], perSet);
+    }
+}
+
+VkDescriptorPool DescriptorAllocator::createPool() {
+    uint32_t sets = _setsPerPool;
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (auto& [type, descriptorsPerSet] : _descriptorsPerSet) {
+        auto count = static_cast<uint32_t>(std::ceil(descriptorsPerSet * sets));
+        if (count > 0) poolSizes.push_back({type, count});
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = sets;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor pool.");
+    }
+    _statistics.poolsCreated++;
+    return pool;
+}
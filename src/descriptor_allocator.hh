@@ -0,0 +1,83 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// Allocates descriptor sets from a chain of VkDescriptorPools per frame in flight. Sets are
+// never freed one by one : beginFrame() resets every pool of the frame with
+// vkResetDescriptorPool. When a frame needed more than one pool, its chain is replaced by a
+// single pool sized for the sets it used, so steady state is one pool and no growth per frame.
+//
+// The descriptors of each type a pool reserves per set start from the ratios. Once a frame
+// allocated from registered layouts only, they follow the per-type counts really used instead.
+//
+// Like the pools it owns, an allocator is externally synchronised : use one per recording
+// thread. beginFrame(i) runs once the GPU is done with frame i.
+class DescriptorAllocator {
+public:
+    // Descriptors of a type reserved per set of pool capacity, before any use was observed.
+    struct PoolRatio {
+        VkDescriptorType type;
+        float descriptorsPerSet;
+    };
+    struct Statistics {
+        uint64_t setsAllocated = 0;
+        uint64_t poolsCreated = 0;
+        uint64_t grows = 0;
+    };
+
+    static const std::vector<PoolRatio> defaultRatios;
+
+    DescriptorAllocator(VkDevice device, uint32_t framesInFlight, uint32_t setsPerPool = 256,
+                        const std::vector<PoolRatio>& ratios = defaultRatios);
+    ~DescriptorAllocator();
+
+    DescriptorAllocator(DescriptorAllocator const&) = delete;
+    void operator=(DescriptorAllocator const&) = delete;
+
+    void beginFrame(uint32_t frameIndex);
+
+    // Bindings `layout` was created with, so the sets allocated from it count towards the
+    // per-type sizing of the pools. Sets of unregistered layouts only count as sets.
+    void registerLayout(VkDescriptorSetLayout layout,
+                        const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+    // Set valid until the frame's next beginFrame(). pNext is chained to the allocate info,
+    // e.g. for variable descriptor counts.
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void* pNext = nullptr);
+
+    const Statistics& getStatistics() const {
+        return _statistics;
+    }
+
+    uint32_t getSetsPerPool() const {
+        return _setsPerPool;
+    }
+
+private:
+    struct Frame {
+        std::vector<VkDescriptorPool> pools;
+        uint32_t sets = 0;
+        uint32_t unregisteredSets = 0;
+        std::map<VkDescriptorType, uint32_t> descriptors;
+    };
+
+    static constexpr uint32_t maxSetsPerPool = 16384;
+
+    VkDevice _device;
+    // Descriptors per set of every type, the largest seen over a frame.
+    std::map<VkDescriptorType, float> _descriptorsPerSet;
+    bool _ratiosReplaced = false;
+    std::unordered_map<VkDescriptorSetLayout, std::map<VkDescriptorType, uint32_t>> _layouts;
+    std::vector<Frame> _frames;
+    uint32_t _frameIndex = 0;
+    uint32_t _setsPerPool;
+    Statistics _statistics;
+
+    void observe(const Frame& frame);
+    VkDescriptorPool createPool();
+};
@@ -0,0 +1,148 @@
+#include "device_pool.hh"
+
+#include <chrono>
+
+std::vector<PhysicalDevice*> DevicePool::defaultDevices() {
+    std::vector<PhysicalDevice*> gpus;
+    std::vector<PhysicalDevice*> all;
+    for (auto* device : PhysicalDevice::getPhysicalDevices()) {
+        all.push_back(device);
+        if (device->getProperties().deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU) {
+            gpus.push_back(device);
+        }
+    }
+    return gpus.empty() ? all : gpus;
+}
+
+DevicePool::DevicePool(const std::vector<PhysicalDevice*>& devices /* = defaultDevices() */) {
+    if (devices.empty()) throw std::runtime_error("Device pool without devices.");
+
+    // Linked GPUs show up as a device group. Jobs being independent, each member still gets
+    // its own VkDevice : a group device would need device masks on every submission and
+    // allocation to get the same parallelism.
+    auto& context = VulkanContext::getInstance();
+    if (context.getApiVersion() >= VK_API_VERSION_1_1) {
+        uint32_t groupCount = 0;
+        vkEnumeratePhysicalDeviceGroups(context.getHandle(), &groupCount, nullptr);
+        std::vector<VkPhysicalDeviceGroupProperties> groups(groupCount);
+        for (auto& group : groups) group.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES;
+        vkEnumeratePhysicalDeviceGroups(context.getHandle(), &groupCount, groups.data());
+        for (auto& group : groups) {
+            if (group.physicalDeviceCount > 1) {
+                std::cerr << "Device group of " << group.physicalDeviceCount
+                          << " GPUs, used as independent devices.\n";
+            }
+        }
+    }
+
+    for (auto physicalDevice : devices) {
+        auto device = std::make_unique<Device>();
+        device->device = std::make_unique<LogicalDevice>(*physicalDevice);
+        _devices.push_back(std::move(device));
+    }
+    for (size_t i = 0; i < _devices.size(); i++) {
+        _devices[i]->worker = std::thread(&DevicePool::workerLoop, this, i);
+    }
+    std::cerr << "Device pool successfully created (" << _devices.size() << " devices).\n";
+}
+
+DevicePool::~DevicePool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+    for (auto& device : _devices) {
+        device->worker.join();
+        vkDeviceWaitIdle(device->device->getHandle());
+    }
+    std::cerr << "Destroyed device pool.\n";
+}
+
+size_t DevicePool::submit(Job job, double cost /* = 1.0 */) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Devices that haven't finished a job yet are assumed as fast as the measured ones.
+    double knownSpeed = 0.0;
+    uint32_t knownCount = 0;
+    for (auto& device : _devices) {
+        if (device->statistics.jobs == 0) continue;
+        knownSpeed += device->statistics.millisecondsPerCost;
+        knownCount++;
+    }
+    double defaultSpeed = knownCount > 0 ? knownSpeed / knownCount : 1.0;
+
+    size_t best = 0;
+    double bestFinish = 0.0;
+    for (size_t i = 0; i < _devices.size(); i++) {
+        auto& device = *_devices[i];
+        double speed = device.statistics.jobs > 0 ? device.statistics.millisecondsPerCost
+                                                  : defaultSpeed;
+        double finish = (device.pendingCost + cost) * speed;
+        if (i == 0 || finish < bestFinish) {
+            best = i;
+            bestFinish = finish;
+        }
+    }
+
+    auto& device = *_devices[best];
+    device.jobs.push_back({std::move(job), cost});
+    device.pendingCost += cost;
+    device.outstanding++;
+    _wakeUp.notify_all();
+    return best;
+}
+
+void DevicePool::waitIdle() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [this]() {
+        for (auto& device : _devices) {
+            if (device->outstanding > 0) return false;
+        }
+        return true;
+    });
+    if (_error) std::rethrow_exception(std::exchange(_error, nullptr));
+}
+
+std::vector<DevicePool::DeviceStatistics> DevicePool::getStatistics() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<DeviceStatistics> statistics;
+    for (auto& device : _devices) statistics.push_back(device->statistics);
+    return statistics;
+}
+
+void DevicePool::workerLoop(size_t index) {
+    auto& device = *_devices[index];
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _wakeUp.wait(lock, [&]() { return _stop || !device.jobs.empty(); });
+        // Queued jobs still run after the stop request.
+        if (device.jobs.empty()) break;
+        Entry entry = std::move(device.jobs.front());
+        device.jobs.pop_front();
+        lock.unlock();
+
+        std::exception_ptr error;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            entry.job(*device.device, index);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        double milliseconds =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                .count();
+
+        lock.lock();
+        if (error && !_error) _error = error;
+        device.pendingCost -= entry.cost;
+        device.outstanding--;
+        auto& statistics = device.statistics;
+        double perCost = milliseconds / std::max(entry.cost, 1e-6);
+        statistics.millisecondsPerCost = statistics.jobs == 0
+                                             ? perCost
+                                             : 0.8 * statistics.millisecondsPerCost + 0.2 * perCost;
+        statistics.jobs++;
+        statistics.busyMilliseconds += milliseconds;
+        _idle.notify_all();
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "application.hh"
+
+// One LogicalDevice per physical device and a scheduler spreading independent jobs (offscreen
+// frames, compute batches) over them. Each device has a worker thread running its jobs in
+// order; a job goes to the device expected to finish it first, from the work already queued
+// there and the device's measured milliseconds per unit of cost, so faster GPUs get more.
+//
+// Jobs get the device and its index, the latter to reach per-device state the caller keeps
+// (renderers, buffers) : a job must only use resources of the device it runs on.
+class DevicePool {
+public:
+    using Job = std::function<void(LogicalDevice&, size_t)>;
+
+    struct DeviceStatistics {
+        uint64_t jobs = 0;
+        double busyMilliseconds = 0.0;
+        // Moving average, what the scheduler uses to compare devices.
+        double millisecondsPerCost = 0.0;
+    };
+
+    // Every device but CPU implementations, unless those are all there is.
+    static std::vector<PhysicalDevice*> defaultDevices();
+
+    explicit DevicePool(const std::vector<PhysicalDevice*>& devices = defaultDevices());
+    ~DevicePool();
+
+    DevicePool(DevicePool const&) = delete;
+    void operator=(DevicePool const&) = delete;
+
+    // `cost` is the job's relative size, 1 for jobs of a kind. Returns the device index.
+    size_t submit(Job job, double cost = 1.0);
+
+    // Rethrows the first exception a job threw since the last call.
+    void waitIdle();
+
+    size_t getDeviceCount() const {
+        return _devices.size();
+    }
+
+    LogicalDevice& getDevice(size_t index) {
+        return *_devices[index]->device;
+    }
+
+    std::vector<DeviceStatistics> getStatistics() const;
+
+private:
+    struct Entry {
+        Job job;
+        double cost;
+    };
+    struct Device {
+        std::unique_ptr<LogicalDevice> device;
+        std::deque<Entry> jobs;
+        // Cost of the queued jobs and of the one running.
+        double pendingCost = 0.0;
+        uint32_t outstanding = 0;
+        DeviceStatistics statistics;
+        std::thread worker;
+    };
+
+    std::vector<std::unique_ptr<Device>> _devices;
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    std::condition_variable _idle;
+    bool _stop = false;
+    std::exception_ptr _error;
+
+    void workerLoop(size_t index);
+};
@@ -0,0 +1,222 @@
+#include "device_scorer.hh"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "builtin_shaders.hh"
+
+static constexpr VkDeviceSize copySize = 64ull << 20;
+static constexpr uint32_t copyRepeats = 8;
+static constexpr uint32_t timedRuns = 3;
+
+DeviceScorer::DeviceScorer(const std::string& cachePath /* = "device_benchmarks.txt" */)
+    : _cachePath(cachePath) {
+    std::ifstream file(_cachePath);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        Measurement measurement;
+        fields >> measurement.vendorID >> measurement.deviceID >> measurement.driverVersion >>
+            measurement.copyGigabytesPerSecond >> measurement.dispatchMicroseconds;
+        if (fields) _measurements.push_back(measurement);
+    }
+}
+
+DeviceScorer::Score DeviceScorer::score(PhysicalDevice& device, bool benchmark) {
+    Score score;
+    score.staticScore = getStaticScore(device);
+    score.total = score.staticScore;
+    if (!benchmark) return score;
+
+    auto& properties = device.getProperties();
+    auto cached = std::find_if(_measurements.begin(), _measurements.end(),
+                               [&](const Measurement& measurement) {
+                                   return measurement.vendorID == properties.vendorID &&
+                                          measurement.deviceID == properties.deviceID &&
+                                          measurement.driverVersion == properties.driverVersion;
+                               });
+    if (cached == _measurements.end()) {
+        // A device failing the benchmark keeps its static score, and is tried again next time.
+        try {
+            _measurements.push_back(measure(device));
+        } catch (const std::exception& exception) {
+            std::cerr << "Benchmark of " << device.getName() << " failed (" << exception.what()
+                      << "), static score only.\n";
+            return score;
+        }
+        cached = _measurements.end() - 1;
+        try {
+            save();
+        } catch (const std::exception& exception) {
+            std::cerr << exception.what() << '\n';
+        }
+    }
+    score.benchmarked = true;
+    score.copyGigabytesPerSecond = cached->copyGigabytesPerSecond;
+    score.dispatchMicroseconds = cached->dispatchMicroseconds;
+    // Bandwidth and dispatch turnaround count about as much as the whole static score does
+    // on a typical discrete GPU.
+    score.total += 10.0 * std::log2(1.0 + score.copyGigabytesPerSecond) +
+                   10.0 * std::log2(1.0 + 1000.0 / std::max(1.0, score.dispatchMicroseconds));
+    return score;
+}
+
+double DeviceScorer::getStaticScore(const PhysicalDevice& device) {
+    auto& properties = device.getProperties();
+    double typeWeight;
+    switch (properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: typeWeight = 1.0; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: typeWeight = 0.6; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: typeWeight = 0.4; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: typeWeight = 0.1; break;
+        default: typeWeight = 0.2; break;
+    }
+
+    // The largest device-local heap : small BAR heaps are device-local too.
+    auto& memory = device.getMemoryProperties();
+    VkDeviceSize deviceLocal = 0;
+    for (uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+        if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            deviceLocal = std::max(deviceLocal, memory.memoryHeaps[i].size);
+        }
+    }
+    double gigabytes = double(deviceLocal) / double(1ull << 30);
+
+    // Both close to 1 on current desktop GPUs.
+    double limits = std::log2(double(properties.limits.maxImageDimension2D)) / 14.0 +
+                    std::log2(double(properties.limits.maxComputeWorkGroupInvocations)) / 10.0;
+    double queues = (device.getDedicatedTransferFamilyIndex() ? 2.0 : 0.0) +
+                    (device.getAsyncComputeFamilyIndex() ? 2.0 : 0.0);
+    return typeWeight * (10.0 + 4.0 * std::log2(1.0 + gigabytes) + limits + queues);
+}
+
+DeviceScorer::Measurement DeviceScorer::measure(PhysicalDevice& physicalDevice) {
+    std::cerr << "Benchmarking " << physicalDevice.getName() << "...\n";
+    LogicalDevice device(physicalDevice);
+    VkDevice handle = device.getHandle();
+    Queue& queue = device.getQueue(QueueRole::Graphics);
+
+    Buffer source(device.getAllocator(), copySize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                  VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    Buffer destination(device.getAllocator(), copySize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                       VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    // Released on every path once the GPU is idle, before the buffers and the device.
+    struct Handles {
+        VkDevice device;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        ~Handles() {
+            vkDeviceWaitIdle(device);
+            if (fence != VK_NULL_HANDLE) vkDestroyFence(device, fence, nullptr);
+            if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, pipeline, nullptr);
+        }
+    } handles{handle};
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = emptyComputeShader.size() * sizeof(uint32_t);
+    moduleInfo.pCode = emptyComputeShader.data();
+    VkShaderModule module;
+    if (vkCreateShaderModule(handle, &moduleInfo, nullptr, &module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create benchmark shader module.");
+    }
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = device.getLayoutCache().getPipelineLayout({});
+    VkResult result = vkCreateComputePipelines(handle, device.getPipelineCache().getHandle(), 1,
+                                               &pipelineInfo, nullptr, &handles.pipeline);
+    vkDestroyShaderModule(handle, module, nullptr);
+    if (result != VK_SUCCESS) throw std::runtime_error("Failed to create benchmark pipeline.");
+
+    auto& pools = device.getCommandPools(QueueRole::Graphics);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    VkCommandBuffer copy = pools.acquire();
+    vkBeginCommandBuffer(copy, &beginInfo);
+    VkBufferCopy region{0, 0, copySize};
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    for (uint32_t i = 0; i < copyRepeats; i++) {
+        // Orders the writes to the same destination, the copies still run at full speed.
+        if (i > 0) {
+            vkCmdPipelineBarrier(copy, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                                 nullptr);
+        }
+        vkCmdCopyBuffer(copy, source.getHandle(), destination.getHandle(), 1, &region);
+    }
+    vkEndCommandBuffer(copy);
+
+    VkCommandBuffer dispatch = pools.acquire();
+    vkBeginCommandBuffer(dispatch, &beginInfo);
+    vkCmdBindPipeline(dispatch, VK_PIPELINE_BIND_POINT_COMPUTE, handles.pipeline);
+    vkCmdDispatch(dispatch, 65535, 16, 1);
+    vkEndCommandBuffer(dispatch);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(handle, &fenceInfo, nullptr, &handles.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create benchmark fence.");
+    }
+    // Submit to fence, best of a few runs : the first one also pays for lazy driver setup.
+    auto time = [&](VkCommandBuffer cmd) {
+        double best = std::numeric_limits<double>::max();
+        for (uint32_t run = 0; run < timedRuns; run++) {
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &cmd;
+            vkResetFences(handle, 1, &handles.fence);
+            auto start = std::chrono::steady_clock::now();
+            if (queue.submit(1, &submitInfo, handles.fence) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to submit benchmark.");
+            }
+            vkWaitForFences(handle, 1, &handles.fence, VK_TRUE, UINT64_MAX);
+            best = std::min(best, std::chrono::duration<double, std::micro>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count());
+        }
+        return best;
+    };
+    double copyMicroseconds = time(copy);
+    double dispatchMicroseconds = time(dispatch);
+
+    auto& properties = physicalDevice.getProperties();
+    Measurement measurement{properties.vendorID, properties.deviceID, properties.driverVersion,
+                            double(copySize * copyRepeats) / (copyMicroseconds * 1000.0),
+                            dispatchMicroseconds};
+    std::cerr << "Copy bandwidth " << measurement.copyGigabytesPerSecond
+              << " GB/s, dispatch turnaround " << dispatchMicroseconds << " us.\n";
+    return measurement;
+}
+
+void DeviceScorer::save() const {
+    std::string tmpPath = _cachePath + ".tmp";
+    {
+        std::ofstream file(tmpPath);
+        if (!file) throw std::runtime_error("Failed to open " + tmpPath + " for writing.");
+        file << "# vendorID deviceID driverVersion copyGigabytesPerSecond dispatchMicroseconds\n";
+        for (auto& measurement : _measurements) {
+            file << measurement.vendorID << ' ' << measurement.deviceID << ' '
+                 << measurement.driverVersion << ' ' << measurement.copyGigabytesPerSecond << ' '
+                 << measurement.dispatchMicroseconds << '\n';
+        }
+        if (!file.flush()) throw std::runtime_error("Failed to write " + tmpPath + ".");
+    }
+    if (std::rename(tmpPath.c_str(), _cachePath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("Failed to write device benchmarks " + _cachePath + ".");
+    }
+}
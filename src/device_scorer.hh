@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "application.hh"
+
+// Ranks physical devices for PhysicalDevice::pickDevice(). The static score weighs the device
+// type, device-local memory, a few limits and the queue families (dedicated transfer, async
+// compute). The optional micro-benchmark measures buffer copy bandwidth and the time of a
+// large dispatch of empty workgroups; results are cached in a text file keyed by vendorID,
+// deviceID and driverVersion, so it only runs again after a driver update.
+class DeviceScorer {
+public:
+    struct Score {
+        double staticScore = 0.0;
+        bool benchmarked = false;
+        double copyGigabytesPerSecond = 0.0;
+        double dispatchMicroseconds = 0.0;
+        double total = 0.0;
+    };
+
+    explicit DeviceScorer(const std::string& cachePath = "device_benchmarks.txt");
+
+    DeviceScorer(DeviceScorer const&) = delete;
+    void operator=(DeviceScorer const&) = delete;
+
+    Score score(PhysicalDevice& device, bool benchmark);
+
+    static double getStaticScore(const PhysicalDevice& device);
+
+private:
+    struct Measurement {
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        double copyGigabytesPerSecond;
+        double dispatchMicroseconds;
+    };
+
+    std::string _cachePath;
+    std::vector<Measurement> _measurements;
+
+    static Measurement measure(PhysicalDevice& device);
+    void save() const;
+};
@@ -0,0 +1,155 @@
+#include "frame_scheduler.hh"
+
+FrameScheduler::FrameScheduler(LogicalDevice& device, uint32_t framesInFlight /* = 2 */)
+    : _device(device),
+      _framesInFlight(std::clamp(framesInFlight, 1u, LogicalDevice::maxFramesInFlight)) {
+    if (!device.hasTimelineSemaphores()) {
+        throw std::runtime_error("Frame scheduling requires timeline semaphores.");
+    }
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(_device.getHandle(), &semaphoreInfo, nullptr, &_timeline) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timeline semaphore.");
+    }
+    std::cerr << "Frame scheduler successfully created (" << _framesInFlight
+              << " frames in flight).\n";
+}
+
+FrameScheduler::~FrameScheduler() {
+    waitIdle();
+    vkDestroySemaphore(_device.getHandle(), _timeline, nullptr);
+}
+
+FrameScheduler::Frame FrameScheduler::beginFrame() {
+    uint64_t number = ++_frame;
+    if (number > _framesInFlight) {
+        uint64_t previous = number - _framesInFlight;
+        if (getCompletedFrame() < previous) {
+            auto start = std::chrono::steady_clock::now();
+            waitFrame(previous);
+            _statistics.stalls++;
+            _statistics.stallMilliseconds += std::chrono::duration<double, std::milli>(
+                                                 std::chrono::steady_clock::now() - start)
+                                                 .count();
+        }
+    }
+    _statistics.frames++;
+    uint64_t completed = getCompletedFrame();
+    uint32_t index = static_cast<uint32_t>(number % _framesInFlight);
+    // Pools first, so the budget monitor's evictors see what this frame no longer needs.
+    _device.getMemoryPools().beginFrame(index, number, completed);
+    _device.getBudgetMonitor().update(number);
+    _device.getDefragmenter().update(number, completed);
+
+    for (size_t role = 0; role < queueRoleCount; role++) {
+        _device.getCommandPools(static_cast<QueueRole>(role)).beginFrame(index);
+    }
+    if (auto* bindlessTable = _device.getBindlessTable()) bindlessTable->beginFrame(index);
+    return {number, index};
+}
+
+void FrameScheduler::submit(QueueRole role, const std::vector<VkCommandBuffer>& commandBuffers,
+                            const std::vector<VkSemaphore>& waitSemaphores /* = {} */,
+                            const std::vector<VkPipelineStageFlags>& waitStages /* = {} */,
+                            const std::vector<VkSemaphore>& signalSemaphores /* = {} */) {
+    submit(role, commandBuffers, waitSemaphores, waitStages, signalSemaphores, false);
+}
+
+void FrameScheduler::endFrame(QueueRole role, const std::vector<VkCommandBuffer>& commandBuffers,
+                              const std::vector<VkSemaphore>& waitSemaphores /* = {} */,
+                              const std::vector<VkPipelineStageFlags>& waitStages /* = {} */,
+                              const std::vector<VkSemaphore>& signalSemaphores /* = {} */) {
+    submit(role, commandBuffers, waitSemaphores, waitStages, signalSemaphores, true);
+}
+
+void FrameScheduler::skipFrame() {
+    // A host signal would claim the previous frames are done too : signal from the queue,
+    // after them.
+    uint64_t waitValue = _endedFrame;
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &_frame;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &_timeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_timeline;
+    if (_device.getQueue(QueueRole::Graphics).submit(1, &submitInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to skip frame.");
+    }
+    _endedFrame = _frame;
+}
+
+uint64_t FrameScheduler::getCompletedFrame() const {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(_device.getHandle(), _timeline, &value);
+    return value;
+}
+
+void FrameScheduler::waitFrame(uint64_t frame) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &_timeline;
+    waitInfo.pValues = &frame;
+    if (vkWaitSemaphores(_device.getHandle(), &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to wait for frame.");
+    }
+}
+
+void FrameScheduler::waitIdle() {
+    if (_endedFrame > 0) waitFrame(_endedFrame);
+}
+
+void FrameScheduler::submit(QueueRole role, const std::vector<VkCommandBuffer>& commandBuffers,
+                            const std::vector<VkSemaphore>& waitSemaphores,
+                            const std::vector<VkPipelineStageFlags>& waitStages,
+                            const std::vector<VkSemaphore>& signalSemaphores, bool signalFrame) {
+    if (waitStages.size() != waitSemaphores.size()) {
+        throw std::runtime_error("Every wait semaphore needs a stage.");
+    }
+    // Values are ignored for binary semaphores, but the arrays must match the semaphore counts.
+    std::vector<uint64_t> waitValues(waitSemaphores.size(), 0);
+    std::vector<VkSemaphore> signals = signalSemaphores;
+    std::vector<uint64_t> signalValues(signals.size(), 0);
+    if (signalFrame) {
+        signals.push_back(_timeline);
+        signalValues.push_back(_frame);
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+    submitInfo.pCommandBuffers = commandBuffers.data();
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signals.size());
+    submitInfo.pSignalSemaphores = signals.data();
+    if (_device.getQueue(role).submit(1, &submitInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit frame.");
+    }
+    if (signalFrame) _endedFrame = _frame;
+}
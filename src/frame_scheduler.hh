@@ -0,0 +1,84 @@
+#pragma once
+
+#include "application.hh"
+
+#include <chrono>
+#include <vector>
+
+// Keeps up to framesInFlight frames queued on the GPU with a single timeline semaphore : frame
+// n signals value n at its last submit, and beginFrame() only waits for frame
+// n - framesInFlight, so the CPU records the next frames while the GPU executes this one.
+// beginFrame() also starts the frame of every CommandPoolManager of the device, of its memory
+// pools and of its bindless table.
+class FrameScheduler {
+public:
+    struct Frame {
+        uint64_t number;
+        uint32_t index;
+    };
+    struct Statistics {
+        uint64_t frames = 0;
+        uint64_t stalls = 0;
+        double stallMilliseconds = 0.0;
+    };
+
+    // framesInFlight goes from 1 to LogicalDevice::maxFramesInFlight.
+    FrameScheduler(LogicalDevice& device, uint32_t framesInFlight = 2);
+    ~FrameScheduler();
+
+    FrameScheduler(FrameScheduler const&) = delete;
+    void operator=(FrameScheduler const&) = delete;
+
+    Frame beginFrame();
+
+    // Submits without signalling the frame, e.g. async compute work the frame depends on.
+    void submit(QueueRole role, const std::vector<VkCommandBuffer>& commandBuffers,
+                const std::vector<VkSemaphore>& waitSemaphores = {},
+                const std::vector<VkPipelineStageFlags>& waitStages = {},
+                const std::vector<VkSemaphore>& signalSemaphores = {});
+
+    // Last submit of the current frame, which signals its timeline value. Binary semaphores
+    // (swapchain acquire and present) can be waited on and signalled alongside.
+    void endFrame(QueueRole role, const std::vector<VkCommandBuffer>& commandBuffers,
+                  const std::vector<VkSemaphore>& waitSemaphores = {},
+                  const std::vector<VkPipelineStageFlags>& waitStages = {},
+                  const std::vector<VkSemaphore>& signalSemaphores = {});
+
+    // Number of the frame being recorded, 0 before the first beginFrame().
+    uint64_t getCurrentFrame() const {
+        return _frame;
+    }
+
+    // Ends the current frame without work, e.g. when no swapchain image could be acquired, so
+    // its timeline value is still reached once the frames before it complete.
+    void skipFrame();
+
+    uint64_t getCompletedFrame() const;
+    void waitFrame(uint64_t frame);
+    void waitIdle();
+
+    VkSemaphore getTimelineSemaphore() const {
+        return _timeline;
+    }
+
+    uint32_t getFramesInFlight() const {
+        return _framesInFlight;
+    }
+
+    Statistics getStatistics() const {
+        return _statistics;
+    }
+
+private:
+    LogicalDevice& _device;
+    uint32_t _framesInFlight;
+    VkSemaphore _timeline = VK_NULL_HANDLE;
+    uint64_t _frame = 0;
+    uint64_t _endedFrame = 0;
+    Statistics _statistics;
+
+    void submit(QueueRole role, const std::vector<VkCommandBuffer>& commandBuffers,
+                const std::vector<VkSemaphore>& waitSemaphores,
+                const std::vector<VkPipelineStageFlags>& waitStages,
+                const std::vector<VkSemaphore>& signalSemaphores, bool signalFrame);
+};
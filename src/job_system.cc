@@ -0,0 +1,132 @@
+#include "job_system.hh"
+
+#include <iostream>
+#include <utility>
+
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local size_t currentQueue = 0;
+
+JobSystem::JobSystem(uint32_t workerCount /* = defaultWorkerCount() */) {
+    for (uint32_t i = 0; i <= workerCount; i++) _queues.push_back(std::make_unique<WorkQueue>());
+    for (uint32_t i = 0; i < workerCount; i++) _workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+    for (auto& worker : _workers) worker.join();
+}
+
+void JobSystem::schedule(std::function<void()> job, JobCounter* counter /* = nullptr */,
+                         JobCounter* dependency /* = nullptr */) {
+    if (counter) counter->_value.fetch_add(1, std::memory_order_relaxed);
+    Job entry{std::move(job), counter};
+    if (dependency) {
+        std::lock_guard<std::mutex> lock(dependency->_mutex);
+        if (!dependency->isDone()) {
+            dependency->_waiters.push_back(std::move(entry));
+            return;
+        }
+    }
+    push(std::move(entry));
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    size_t queueIndex = localQueueIndex();
+    while (!counter.isDone()) {
+        if (tryRunOne(queueIndex)) continue;
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeUp.wait(lock, [&]() { return counter.isDone() || _queued.load() > 0; });
+    }
+    std::exception_ptr exception;
+    {
+        // Also waits for run() to be done with the counter, which may die once we return.
+        std::lock_guard<std::mutex> lock(counter._mutex);
+        exception = std::exchange(counter._exception, nullptr);
+    }
+    if (exception) std::rethrow_exception(exception);
+}
+
+void JobSystem::push(Job job) {
+    auto& queue = *_queues[localQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    _queued.fetch_add(1, std::memory_order_release);
+    // Taking the lock orders this push with a worker about to sleep, so the wake-up isn't lost.
+    { std::lock_guard<std::mutex> lock(_sleepMutex); }
+    _wakeUp.notify_one();
+}
+
+bool JobSystem::tryRunOne(size_t queueIndex) {
+    Job job;
+    bool found = false;
+    {
+        auto& own = *_queues[queueIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            found = true;
+        }
+    }
+    for (size_t k = 1; !found && k < _queues.size(); k++) {
+        auto& victim = *_queues[(queueIndex + k) % _queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            found = true;
+        }
+    }
+    if (!found) return false;
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+    run(job);
+    return true;
+}
+
+void JobSystem::run(Job& job) {
+    JobCounter* counter = job.counter;
+    try {
+        job.function();
+    } catch (...) {
+        if (counter == nullptr) {
+            std::cerr << "Job failed with an exception, dropped as nothing waits for it.\n";
+        } else {
+            std::lock_guard<std::mutex> lock(counter->_mutex);
+            if (!counter->_exception) counter->_exception = std::current_exception();
+        }
+    }
+    if (counter == nullptr) return;
+
+    // The counter reaches zero under its lock, which wait() takes before returning : the
+    // counter isn't touched past this block, it may already be destroyed.
+    std::vector<Job> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->_mutex);
+        if (counter->_value.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        released.swap(counter->_waiters);
+    }
+    for (auto& waiter : released) push(std::move(waiter));
+    { std::lock_guard<std::mutex> lock(_sleepMutex); }
+    _wakeUp.notify_all();
+}
+
+void JobSystem::workerLoop(size_t queueIndex) {
+    currentSystem = this;
+    currentQueue = queueIndex;
+    while (true) {
+        if (tryRunOne(queueIndex)) continue;
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wakeUp.wait(lock, [this]() { return _stop || _queued.load() > 0; });
+        if (_stop && _queued.load() == 0) break;
+    }
+}
+
+size_t JobSystem::localQueueIndex() const {
+    return currentSystem == this ? currentQueue : _queues.size() - 1;
+}
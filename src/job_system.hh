@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// Number of unfinished jobs of a group. Jobs can be scheduled to start only once a counter
+// has dropped to zero, which is how dependencies between groups are expressed. A job throwing
+// still counts as finished : the first exception of the group is kept for wait() to rethrow.
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(JobCounter const&) = delete;
+    void operator=(JobCounter const&) = delete;
+
+    bool isDone() const {
+        return _value.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+    struct Job {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+
+    std::atomic<uint32_t> _value{0};
+    std::mutex _mutex;
+    std::vector<Job> _waiters;
+    std::exception_ptr _exception;
+};
+
+// Work-stealing scheduler : every worker owns a deque, runs its own jobs newest first and
+// steals the oldest jobs of the others when it runs dry. Threads blocked in wait() run jobs
+// too, and only sleep while there is none to run.
+class JobSystem {
+public:
+    explicit JobSystem(uint32_t workerCount = defaultWorkerCount());
+    ~JobSystem();
+
+    JobSystem(JobSystem const&) = delete;
+    void operator=(JobSystem const&) = delete;
+
+    // `counter` is incremented now and decremented once the job has run. With `dependency`,
+    // the job is held back until that counter reaches zero. Exceptions of jobs without a
+    // counter are logged and dropped.
+    void schedule(std::function<void()> job, JobCounter* counter = nullptr,
+                  JobCounter* dependency = nullptr);
+
+    // Returns once every job of `counter` has run, then rethrows the first exception of them.
+    void wait(JobCounter& counter);
+
+    // Calls function(i) for every i in [begin, end), `grain` indices per job (0 picks one).
+    template <typename Function>
+    void parallelFor(size_t begin, size_t end, Function&& function, size_t grain = 0) {
+        if (begin >= end) return;
+        if (grain == 0) grain = std::max<size_t>(1, (end - begin) / (4 * (_workers.size() + 1)));
+        JobCounter counter;
+        for (size_t chunk = begin; chunk < end; chunk += grain) {
+            size_t chunkEnd = std::min(end, chunk + grain);
+            schedule(
+                [&function, chunk, chunkEnd]() {
+                    for (size_t i = chunk; i < chunkEnd; i++) function(i);
+                },
+                &counter);
+        }
+        wait(counter);
+    }
+
+    uint32_t getWorkerCount() const {
+        return static_cast<uint32_t>(_workers.size());
+    }
+
+    static uint32_t defaultWorkerCount() {
+        return std::max(1u, std::thread::hardware_concurrency()) - 1;
+    }
+
+private:
+    using Job = JobCounter::Job;
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    // One queue per worker, the last one is shared by threads outside the pool.
+    std::vector<std::unique_ptr<WorkQueue>> _queues;
+    std::vector<std::thread> _workers;
+    std::atomic<uint32_t> _queued{0};
+    std::atomic<bool> _stop{false};
+    std::mutex _sleepMutex;
+    std::condition_variable _wakeUp;
+
+    void push(Job job);
+    bool tryRunOne(size_t queueIndex);
+    void run(Job& job);
+    void workerLoop(size_t queueIndex);
+    size_t localQueueIndex() const;
+};
@@ -0,0 +1,237 @@
+#include "layout_cache.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "utils.hh"
+
+bool LayoutCache::SetLayoutKey::operator==(const SetLayoutKey& other) const {
+    if (flags != other.flags || bindings.size() != other.bindings.size()) return false;
+    for (size_t i = 0; i < bindings.size(); i++) {
+        auto& a = bindings[i];
+        auto& b = other.bindings[i];
+        if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+            a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) {
+            return false;
+        }
+    }
+    return bindingFlags == other.bindingFlags && samplerOffsets == other.samplerOffsets &&
+           samplers == other.samplers;
+}
+
+bool LayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const {
+    if (setLayouts != other.setLayouts || pushConstants.size() != other.pushConstants.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < pushConstants.size(); i++) {
+        auto& a = pushConstants[i];
+        auto& b = other.pushConstants[i];
+        if (a.stageFlags != b.stageFlags || a.offset != b.offset || a.size != b.size) return false;
+    }
+    return true;
+}
+
+LayoutCache::LayoutCache(VkDevice device) : _device(device) {
+}
+
+LayoutCache::~LayoutCache() {
+    _pipelineLayouts.forEach(
+        [&](VkPipelineLayout layout) { vkDestroyPipelineLayout(_device, layout, nullptr); });
+    _setLayouts.forEach([&](VkDescriptorSetLayout layout) {
+        vkDestroyDescriptorSetLayout(_device, layout, nullptr);
+    });
+}
+
+VkDescriptorSetLayout LayoutCache::getDescriptorSetLayout(
+    std::vector<VkDescriptorSetLayoutBinding> bindings,
+    VkDescriptorSetLayoutCreateFlags flags /* = 0 */,
+    std::vector<VkDescriptorBindingFlags> bindingFlags /* = {} */) {
+    if (!bindingFlags.empty() && bindingFlags.size() != bindings.size()) {
+        throw std::runtime_error("Binding flags don't match the bindings.");
+    }
+
+    SetLayoutKey key;
+    key.flags = flags;
+    std::vector<size_t> order(bindings.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return bindings[a].binding < bindings[b].binding; });
+    for (size_t i : order) {
+        auto binding = bindings[i];
+        if (binding.pImmutableSamplers != nullptr) {
+            key.samplerOffsets.push_back(static_cast<uint32_t>(key.samplers.size()));
+            key.samplers.insert(key.samplers.end(), binding.pImmutableSamplers,
+                                binding.pImmutableSamplers + binding.descriptorCount);
+        } else {
+            key.samplerOffsets.push_back(~0u);
+        }
+        binding.pImmutableSamplers = nullptr;
+        key.bindings.push_back(binding);
+        if (!bindingFlags.empty()) key.bindingFlags.push_back(bindingFlags[i]);
+    }
+
+    size_t keyHash = hash(key);
+    if (auto layout = _setLayouts.find(keyHash, key)) {
+        _setLayoutHits.fetch_add(1, std::memory_order_relaxed);
+        return layout;
+    }
+
+    std::lock_guard<std::mutex> lock(_insertMutex);
+    if (auto layout = _setLayouts.find(keyHash, key)) {
+        _setLayoutHits.fetch_add(1, std::memory_order_relaxed);
+        return layout;
+    }
+    _setLayoutMisses.fetch_add(1, std::memory_order_relaxed);
+
+    auto createBindings = key.bindings;
+    for (size_t i = 0; i < createBindings.size(); i++) {
+        if (key.samplerOffsets[i] != ~0u) {
+            createBindings[i].pImmutableSamplers = &key.samplers[key.samplerOffsets[i]];
+        }
+    }
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flagsInfo.bindingCount = static_cast<uint32_t>(key.bindingFlags.size());
+    flagsInfo.pBindingFlags = key.bindingFlags.data();
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = key.bindingFlags.empty() ? nullptr : &flagsInfo;
+    layoutInfo.flags = flags;
+    layoutInfo.bindingCount = static_cast<uint32_t>(createBindings.size());
+    layoutInfo.pBindings = createBindings.data();
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout.");
+    }
+    _setLayouts.insert(keyHash, std::move(key), layout);
+    return layout;
+}
+
+VkPipelineLayout LayoutCache::getPipelineLayout(
+    const std::vector<VkDescriptorSetLayout>& setLayouts,
+    const std::vector<VkPushConstantRange>& pushConstants /* = {} */) {
+    PipelineLayoutKey key{setLayouts, pushConstants};
+    size_t keyHash = hash(key);
+    if (auto layout = _pipelineLayouts.find(keyHash, key)) {
+        _pipelineLayoutHits.fetch_add(1, std::memory_order_relaxed);
+        return layout;
+    }
+
+    std::lock_guard<std::mutex> lock(_insertMutex);
+    if (auto layout = _pipelineLayouts.find(keyHash, key)) {
+        _pipelineLayoutHits.fetch_add(1, std::memory_order_relaxed);
+        return layout;
+    }
+    _pipelineLayoutMisses.fetch_add(1, std::memory_order_relaxed);
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    layoutInfo.pSetLayouts = setLayouts.data();
+    layoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+    layoutInfo.pPushConstantRanges = pushConstants.data();
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout.");
+    }
+    _pipelineLayouts.insert(keyHash, std::move(key), layout);
+    return layout;
+}
+
+LayoutCache::ReflectedLayout LayoutCache::getReflectedLayout(
+    const std::vector<const ShaderReflection*>& stages,
+    const std::map<uint32_t, VkDescriptorSetLayout>& externalSets /* = {} */) {
+    std::map<uint32_t, std::map<uint32_t, VkDescriptorSetLayoutBinding>> sets;
+    std::vector<VkPushConstantRange> pushConstants;
+    for (auto stage : stages) {
+        for (auto& binding : stage->bindings) {
+            if (externalSets.count(binding.set)) continue;
+            if (binding.count == 0) {
+                throw std::runtime_error("Runtime descriptor array outside an external set.");
+            }
+            auto inserted = sets[binding.set].emplace(
+                binding.binding, VkDescriptorSetLayoutBinding{binding.binding, binding.type,
+                                                              binding.count, 0, nullptr});
+            auto& merged = inserted.first->second;
+            if (merged.descriptorType != binding.type || merged.descriptorCount != binding.count) {
+                throw std::runtime_error("Shader stages disagree on set " +
+                                         std::to_string(binding.set) + " binding " +
+                                         std::to_string(binding.binding) + ".");
+            }
+            merged.stageFlags |= stage->stage;
+        }
+
+        if (stage->pushConstantSize == 0) continue;
+        auto same = std::find_if(pushConstants.begin(), pushConstants.end(),
+                                 [&](const VkPushConstantRange& range) {
+                                     return range.offset == stage->pushConstantOffset &&
+                                            range.size == stage->pushConstantSize;
+                                 });
+        if (same != pushConstants.end()) {
+            same->stageFlags |= stage->stage;
+        } else {
+            pushConstants.push_back(
+                {static_cast<VkShaderStageFlags>(stage->stage), stage->pushConstantOffset,
+                 stage->pushConstantSize});
+        }
+    }
+
+    uint32_t setCount = 0;
+    if (!sets.empty()) setCount = sets.rbegin()->first + 1;
+    if (!externalSets.empty()) setCount = std::max(setCount, externalSets.rbegin()->first + 1);
+
+    ReflectedLayout result;
+    for (uint32_t set = 0; set < setCount; set++) {
+        auto external = externalSets.find(set);
+        if (external != externalSets.end()) {
+            result.setLayouts.push_back(external->second);
+            continue;
+        }
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        auto reflected = sets.find(set);
+        if (reflected != sets.end()) {
+            for (auto& binding : reflected->second) bindings.push_back(binding.second);
+        }
+        result.setLayouts.push_back(getDescriptorSetLayout(std::move(bindings)));
+    }
+    result.pipelineLayout = getPipelineLayout(result.setLayouts, pushConstants);
+    return result;
+}
+
+LayoutCache::Statistics LayoutCache::getStatistics() const {
+    Statistics statistics;
+    statistics.setLayoutHits = _setLayoutHits.load(std::memory_order_relaxed);
+    statistics.setLayoutMisses = _setLayoutMisses.load(std::memory_order_relaxed);
+    statistics.pipelineLayoutHits = _pipelineLayoutHits.load(std::memory_order_relaxed);
+    statistics.pipelineLayoutMisses = _pipelineLayoutMisses.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+size_t LayoutCache::hash(const SetLayoutKey& key) {
+    Hasher hasher;
+    hasher.add(key.flags);
+    for (auto& binding : key.bindings) {
+        hasher.add(binding.binding);
+        hasher.add(binding.descriptorType);
+        hasher.add(binding.descriptorCount);
+        hasher.add(binding.stageFlags);
+    }
+    for (auto flags : key.bindingFlags) hasher.add(flags);
+    for (auto offset : key.samplerOffsets) hasher.add(offset);
+    for (auto sampler : key.samplers) hasher.add(sampler);
+    return static_cast<size_t>(hasher.value);
+}
+
+size_t LayoutCache::hash(const PipelineLayoutKey& key) {
+    Hasher hasher;
+    for (auto layout : key.setLayouts) hasher.add(layout);
+    for (auto& range : key.pushConstants) {
+        hasher.add(range.stageFlags);
+        hasher.add(range.offset);
+        hasher.add(range.size);
+    }
+    return static_cast<size_t>(hasher.value);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "spirv_reflection.hh"
+
+// Deduplicates descriptor set layouts and pipeline layouts by their structure : asking twice
+// for the same bindings or the same sets and push constants returns the same handle. Lookups
+// never lock, only the creation of a new layout does. Handles live as long as the cache.
+class LayoutCache {
+public:
+    struct Statistics {
+        uint64_t setLayoutHits = 0;
+        uint64_t setLayoutMisses = 0;
+        uint64_t pipelineLayoutHits = 0;
+        uint64_t pipelineLayoutMisses = 0;
+    };
+
+    explicit LayoutCache(VkDevice device);
+    ~LayoutCache();
+
+    LayoutCache(LayoutCache const&) = delete;
+    void operator=(LayoutCache const&) = delete;
+
+    // Binding order doesn't matter. bindingFlags, when given, matches bindings one to one.
+    VkDescriptorSetLayout getDescriptorSetLayout(
+        std::vector<VkDescriptorSetLayoutBinding> bindings,
+        VkDescriptorSetLayoutCreateFlags flags = 0,
+        std::vector<VkDescriptorBindingFlags> bindingFlags = {});
+
+    VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts,
+                                       const std::vector<VkPushConstantRange>& pushConstants = {});
+
+    struct ReflectedLayout {
+        // Indexed by set number, gaps filled with an empty layout.
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        VkPipelineLayout pipelineLayout;
+    };
+
+    // Smallest layouts covering the given stages : each binding is visible to the stages
+    // using it only, and each stage gets the push constant range it reads. Sets listed in
+    // `externalSets` (e.g. the bindless table's) are used as is instead of being reflected;
+    // they are the only ones allowed to hold runtime arrays. Throws when stages disagree on
+    // a binding.
+    ReflectedLayout getReflectedLayout(
+        const std::vector<const ShaderReflection*>& stages,
+        const std::map<uint32_t, VkDescriptorSetLayout>& externalSets = {});
+
+    Statistics getStatistics() const;
+
+private:
+    struct SetLayoutKey {
+        VkDescriptorSetLayoutCreateFlags flags;
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlags> bindingFlags;
+        // Immutable samplers of all bindings, flattened. The pointers of the bindings are
+        // replaced by offsets into it, ~0 for bindings without.
+        std::vector<uint32_t> samplerOffsets;
+        std::vector<VkSampler> samplers;
+
+        bool operator==(const SetLayoutKey& other) const;
+    };
+    struct PipelineLayoutKey {
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        std::vector<VkPushConstantRange> pushConstants;
+
+        bool operator==(const PipelineLayoutKey& other) const;
+    };
+
+    // Singly linked buckets. Nodes are immutable once published with a release store, so
+    // readers walk them without locking; only inserts take the mutex.
+    template <typename Key, typename Handle>
+    class Table {
+    public:
+        struct Node {
+            size_t hash;
+            Key key;
+            Handle handle;
+            Node* next;
+        };
+
+        ~Table() {
+            for (auto& bucket : _buckets) {
+                Node* node = bucket.load(std::memory_order_relaxed);
+                while (node) {
+                    Node* next = node->next;
+                    delete node;
+                    node = next;
+                }
+            }
+        }
+
+        Handle find(size_t hash, const Key& key) const {
+            Node* node = _buckets[hash % bucketCount].load(std::memory_order_acquire);
+            for (; node; node = node->next) {
+                if (node->hash == hash && node->key == key) return node->handle;
+            }
+            return VK_NULL_HANDLE;
+        }
+
+        // Caller holds the insert lock and checked find() under it.
+        void insert(size_t hash, Key key, Handle handle) {
+            auto& bucket = _buckets[hash % bucketCount];
+            Node* head = bucket.load(std::memory_order_relaxed);
+            bucket.store(new Node{hash, std::move(key), handle, head}, std::memory_order_release);
+        }
+
+        template <typename Function>
+        void forEach(Function function) const {
+            for (auto& bucket : _buckets) {
+                Node* node = bucket.load(std::memory_order_acquire);
+                for (; node; node = node->next) function(node->handle);
+            }
+        }
+
+    private:
+        static constexpr size_t bucketCount = 1024;
+        std::array<std::atomic<Node*>, bucketCount> _buckets{};
+    };
+
+    VkDevice _device;
+    Table<SetLayoutKey, VkDescriptorSetLayout> _setLayouts;
+    Table<PipelineLayoutKey, VkPipelineLayout> _pipelineLayouts;
+    std::mutex _insertMutex;
+    std::atomic<uint64_t> _setLayoutHits{0};
+    std::atomic<uint64_t> _setLayoutMisses{0};
+    std::atomic<uint64_t> _pipelineLayoutHits{0};
+    std::atomic<uint64_t> _pipelineLayoutMisses{0};
+
+    static size_t hash(const SetLayoutKey& key);
+    static size_t hash(const PipelineLayoutKey& key);
+};
@@ -1,10 +1,295 @@
 #include "application.hh"
+#include "device_pool.hh"
+#include "offscreen_renderer.hh"
+#include "staging_uploader.hh"
 
-int main() {
-    auto window = Window();
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// Clears the frame to a color cycling with its index.
+static OffscreenRenderer::RecordFunction clearFrame(uint32_t index) {
+    float shade = float(index % 256) / 255.0f;
+    return [shade](VkCommandBuffer cmd, const Image& image) {
+        VkClearColorValue color = {{shade, 0.5f, 1.0f - shade, 1.0f}};
+        VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdClearColorImage(cmd, image.getHandle(), VK_IMAGE_LAYOUT_GENERAL, &color, 1, &range);
+    };
+}
+
+// Same frame as clearFrame, recorded as one secondary command buffer per job system thread :
+// each clears the image in turn, the last one with the frame's own color, so the result and the
+// checksum match clearFrame's.
+static OffscreenRenderer::RecordFunction clearFrameSecondary(LogicalDevice& logicalDevice,
+                                                             JobSystem& jobs, uint32_t index) {
+    return [&logicalDevice, &jobs, index](VkCommandBuffer cmd, const Image& image) {
+        uint32_t count = jobs.getWorkerCount() + 1;
+        auto record = [&](VkCommandBuffer secondary, uint32_t i) {
+            if (i > 0) {
+                // After the clear of the previous secondary, in submission order.
+                VkMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                vkCmdPipelineBarrier(secondary, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr,
+                                     0, nullptr);
+            }
+            clearFrame(index + count - 1 - i)(secondary, image);
+        };
+        VkCommandBufferInheritanceInfo inheritance{};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        auto secondaries = logicalDevice.getCommandPools(QueueRole::Graphics)
+                               .recordSecondary(jobs, count, inheritance, record);
+        vkCmdExecuteCommands(cmd, count, secondaries.data());
+    };
+}
+
+// Renders frameCount frames offscreen and reads each one back, without GLFW or a window.
+// A Chrome trace of the run is written to tracePath when it isn't empty.
+// With VKAPP_SECONDARY_COMMANDS set, frames are recorded as secondary command buffers on a
+// JobSystem instead.
+static void runHeadless(LogicalDevice& logicalDevice, uint32_t frameCount,
+                        const std::string& tracePath) {
+    OffscreenRenderer renderer(logicalDevice, {800, 600});
+    std::unique_ptr<JobSystem> jobs;
+    if (std::getenv("VKAPP_SECONDARY_COMMANDS") != nullptr) jobs = std::make_unique<JobSystem>();
+    const uint64_t lag = LogicalDevice::maxFramesInFlight - 1;
+    uint64_t checksum = 0;
+    auto consume = [&](uint64_t frame) {
+        const uint8_t* pixels = renderer.readback(frame);
+        for (VkDeviceSize i = 0; i < renderer.getFrameSize(); i += 4096) checksum += pixels[i];
+    };
+
+    if (!tracePath.empty()) logicalDevice.getProfiler().setCapturing(true);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frameCount; i++) {
+        CpuZone zone(logicalDevice.getProfiler(), "frame");
+        uint64_t frame = renderer.render(jobs ? clearFrameSecondary(logicalDevice, *jobs, i)
+                                              : clearFrame(i));
+        if (frame > lag) consume(frame - lag);
+    }
+    for (uint64_t frame = frameCount > lag ? frameCount - lag + 1 : 1; frame <= frameCount;
+         frame++) {
+        consume(frame);
+    }
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered and read back " << frameCount << " frames in " << seconds * 1000.0
+              << " ms (" << (seconds > 0.0 ? frameCount / seconds : 0.0)
+              << " frames/s, checksum " << checksum << ").\n";
+    if (!tracePath.empty()) logicalDevice.getProfiler().writeChromeTrace(tracePath);
+}
+
+// Same frames as runHeadless, spread over every GPU of the machine by a DevicePool.
+static void runHeadlessPool(uint32_t frameCount) {
+    DevicePool pool;
+    // Declared after the pool, so destroyed before the devices they live on.
+    std::vector<std::unique_ptr<OffscreenRenderer>> renderers;
+    for (size_t i = 0; i < pool.getDeviceCount(); i++) {
+        renderers.push_back(
+            std::make_unique<OffscreenRenderer>(pool.getDevice(i), VkExtent2D{800, 600}));
+    }
+    // Started once every device is up, as main() reports for a single one.
+    auto& startupTimer = StartupTimer::getInstance();
+    std::cerr << "Started in " << startupTimer.getElapsedMilliseconds() << " ms.\n";
+    startupTimer.writeJsonFromEnvironment();
+    startupTimer.finish();
+
+    std::atomic<uint64_t> checksum{0};
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frameCount; i++) {
+        pool.submit([&renderers, &checksum, i](LogicalDevice&, size_t device) {
+            auto& renderer = *renderers[device];
+            const uint8_t* pixels = renderer.readback(renderer.render(clearFrame(i)));
+            uint64_t sum = 0;
+            for (VkDeviceSize j = 0; j < renderer.getFrameSize(); j += 4096) sum += pixels[j];
+            checksum += sum;
+        });
+    }
+    pool.waitIdle();
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered and read back " << frameCount << " frames on " << pool.getDeviceCount()
+              << " devices in " << seconds * 1000.0 << " ms (checksum " << checksum << ").\n";
+    auto statistics = pool.getStatistics();
+    for (size_t i = 0; i < statistics.size(); i++) {
+        std::cout << "Device " << i << " : " << statistics[i].jobs << " frames, "
+                  << statistics[i].busyMilliseconds << " ms busy.\n";
+    }
+}
+
+// Uploads buffers and images through a small StagingUploader, one buffer larger than the ring
+// so it is split, then copies everything back to host memory on the graphics queue and compares
+// it with what was uploaded. Returns whether every byte matched.
+static bool checkUploads(LogicalDevice& logicalDevice) {
+    constexpr VkDeviceSize ringCapacity = 1 << 20;
+    StagingUploader uploader(logicalDevice, ringCapacity);
+    auto& allocator = logicalDevice.getAllocator();
+    std::vector<uint32_t> families = uploader.getQueueFamilies();
+    VkSharingMode sharingMode =
+        families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    VmaAllocationCreateInfo allocationInfo{};
+    allocationInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    // Xorshift bytes : a copy landing at the wrong offset can't match by chance.
+    uint32_t state = 0x9e3779b9;
+    auto makeContents = [&state](VkDeviceSize size) {
+        std::vector<uint8_t> contents(size);
+        for (auto& byte : contents) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            byte = uint8_t(state);
+        }
+        return contents;
+    };
+
+    std::vector<std::vector<uint8_t>> expected;
+    std::vector<Buffer> buffers;
+    for (VkDeviceSize size : {VkDeviceSize(256), VkDeviceSize(64 << 10), 3 * ringCapacity + 12}) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = sharingMode;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+        bufferInfo.pQueueFamilyIndices = families.data();
+        buffers.emplace_back(allocator, bufferInfo, allocationInfo);
+        expected.push_back(makeContents(size));
+        uploader.upload(expected.back().data(), size, buffers.back().getHandle());
+    }
+    std::vector<Image> images;
+    for (VkExtent2D extent : {VkExtent2D{256, 256}, VkExtent2D{300, 200}}) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        imageInfo.extent = {extent.width, extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = sharingMode;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+        imageInfo.pQueueFamilyIndices = families.data();
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        images.emplace_back(allocator, imageInfo, allocationInfo);
+        VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * 4;
+        expected.push_back(makeContents(size));
+        uploader.upload(expected.back().data(), size, images.back(),
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    }
+    uploader.flush();
+    uploader.waitIdle();
+
+    VkDeviceSize readbackSize = 0;
+    for (auto& contents : expected) readbackSize += contents.size();
+    Buffer readback(allocator, readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VMA_MEMORY_USAGE_AUTO,
+                    VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                        VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+    VkCommandBuffer cmd = logicalDevice.getCommandPools(QueueRole::Graphics).acquire();
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmd, &beginInfo);
+    VkDeviceSize offset = 0;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        VkBufferCopy region{0, offset, expected[i].size()};
+        vkCmdCopyBuffer(cmd, buffers[i].getHandle(), readback.getHandle(), 1, &region);
+        offset += region.size;
+    }
+    for (size_t i = 0; i < images.size(); i++) {
+        VkBufferImageCopy region{};
+        region.bufferOffset = offset;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = images[i].getExtent();
+        vkCmdCopyImageToBuffer(cmd, images[i].getHandle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               readback.getHandle(), 1, &region);
+        offset += expected[buffers.size() + i].size();
+    }
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                         &hostBarrier, 0, nullptr, 0, nullptr);
+    vkEndCommandBuffer(cmd);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    if (vkCreateFence(logicalDevice.getHandle(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload check fence.");
+    }
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    VkResult result = logicalDevice.getQueue(QueueRole::Graphics).submit(1, &submitInfo, fence);
+    if (result == VK_SUCCESS) {
+        vkWaitForFences(logicalDevice.getHandle(), 1, &fence, VK_TRUE, UINT64_MAX);
+    }
+    vkDestroyFence(logicalDevice.getHandle(), fence, nullptr);
+    if (result != VK_SUCCESS) throw std::runtime_error("Failed to submit upload check readback.");
+
+    vmaInvalidateAllocation(allocator.getHandle(), readback.getAllocation(), 0, VK_WHOLE_SIZE);
+    auto data = static_cast<const uint8_t*>(readback.getMappedData());
+    size_t mismatches = 0;
+    offset = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        bool match = std::memcmp(data + offset, expected[i].data(), expected[i].size()) == 0;
+        std::cout << (i < buffers.size() ? "Buffer " : "Image ")
+                  << (i < buffers.size() ? i : i - buffers.size()) << " (" << expected[i].size()
+                  << " bytes) : " << (match ? "ok" : "MISMATCH") << '\n';
+        if (!match) mismatches++;
+        offset += expected[i].size();
+    }
+    auto statistics = uploader.getStatistics();
+    std::cout << "Uploaded " << statistics.bytesUploaded << " bytes in " << statistics.batches
+              << " batches with " << statistics.stalls << " stalls, " << mismatches
+              << " mismatches.\n";
+    return mismatches == 0;
+}
+
+// VKAPP_DEVICE_SELECTION picks the device selection policy : "score" or "benchmark".
+static PhysicalDevice::Selection deviceSelection() {
+    const char* selection = std::getenv("VKAPP_DEVICE_SELECTION");
+    if (selection == nullptr) return PhysicalDevice::Selection::FirstDiscrete;
+    if (std::string(selection) == "score") return PhysicalDevice::Selection::Scored;
+    if (std::string(selection) == "benchmark") return PhysicalDevice::Selection::Benchmarked;
+    return PhysicalDevice::Selection::FirstDiscrete;
+}
+
+int main(int argc, char** argv) {
+    auto& startupTimer = StartupTimer::getInstance();
+    bool checkingUploads = argc > 1 && std::string(argv[1]) == "--check-uploads";
+    bool headless = checkingUploads || (argc > 1 && std::string(argv[1]) == "--headless");
+    std::unique_ptr<Window> window;
+    if (headless) {
+        VulkanContext::setHeadless(true);
+    } else {
+        StartupPhase phase("Window");
+        window = std::make_unique<Window>();
+    }
     VulkanContext::getInstance();
-    auto& physicalDevice = PhysicalDevice::pickDevice();
+    if (headless && !checkingUploads && std::getenv("VKAPP_MULTI_GPU") != nullptr) {
+        runHeadlessPool(argc > 2 ? std::stoul(argv[2]) : 100);
+        return 0;
+    }
+    auto& physicalDevice = PhysicalDevice::pickDevice(false, deviceSelection());
     std::cout << "Chosen device : " << physicalDevice.getName() << '\n';
     auto logicalDevice = LogicalDevice(physicalDevice);
+    std::cerr << "Started in " << startupTimer.getElapsedMilliseconds() << " ms.\n";
+    startupTimer.writeJsonFromEnvironment();
+    startupTimer.finish();
+    if (checkingUploads) return checkUploads(logicalDevice) ? 0 : 1;
+    if (headless) {
+        runHeadless(logicalDevice, argc > 2 ? std::stoul(argv[2]) : 100, argc > 3 ? argv[3] : "");
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,290 @@
+#include "memory_pools.hh"
+
+#include <algorithm>
+
+static constexpr VkDeviceSize transientCapacity = 4ull << 20;
+static constexpr VkDeviceSize streamingBlockSize = 64ull << 20;
+static constexpr VkBufferUsageFlags transientUsage =
+    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+static constexpr VkBufferUsageFlags streamingUsage =
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+static constexpr VkBufferUsageFlags generalBufferUsage =
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+static constexpr VkImageUsageFlags generalImageUsage =
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t findBufferMemoryType(Allocator& allocator, VkBufferUsageFlags usage,
+                                     const VmaAllocationCreateInfo& allocationInfo) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = 65536;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    uint32_t memoryTypeIndex;
+    if (vmaFindMemoryTypeIndexForBufferInfo(allocator.getHandle(), &bufferInfo, &allocationInfo,
+                                            &memoryTypeIndex) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to find a memory type for a memory pool.");
+    }
+    return memoryTypeIndex;
+}
+
+static uint32_t findImageMemoryType(Allocator& allocator, VkImageUsageFlags usage,
+                                    const VmaAllocationCreateInfo& allocationInfo) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = {256, 256, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    uint32_t memoryTypeIndex;
+    if (vmaFindMemoryTypeIndexForImageInfo(allocator.getHandle(), &imageInfo, &allocationInfo,
+                                           &memoryTypeIndex) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to find a memory type for a memory pool.");
+    }
+    return memoryTypeIndex;
+}
+
+MemoryPool::MemoryPool(Allocator& allocator, const char* name, Policy policy,
+                       uint32_t memoryTypeIndex, VkDeviceSize blockSize /* = 0 */,
+                       size_t maxBlockCount /* = 0 */)
+    : _allocator(allocator), _policy(policy), _memoryTypeIndex(memoryTypeIndex) {
+    const VkPhysicalDeviceMemoryProperties* properties;
+    vmaGetMemoryProperties(_allocator.getHandle(), &properties);
+    _heapIndex = properties->memoryTypes[memoryTypeIndex].heapIndex;
+    VmaPoolCreateInfo createInfo{};
+    createInfo.memoryTypeIndex = memoryTypeIndex;
+    createInfo.blockSize = blockSize;
+    createInfo.maxBlockCount = maxBlockCount;
+    if (policy != Policy::General) createInfo.flags = VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT;
+    // Wrapping around only happens within the single block of the pool.
+    if (policy == Policy::Ring) createInfo.maxBlockCount = 1;
+    if (vmaCreatePool(_allocator.getHandle(), &createInfo, &_handle) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create memory pool.");
+    }
+    vmaSetPoolName(_allocator.getHandle(), _handle, name);
+    std::cerr << "Memory pool " << name << " successfully created (memory type "
+              << memoryTypeIndex << ").\n";
+}
+
+MemoryPool::~MemoryPool() {
+    vmaDestroyPool(_allocator.getHandle(), _handle);
+}
+
+Buffer MemoryPool::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                VmaAllocationCreateFlags flags /* = 0 */) {
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = size;
+    createInfo.usage = usage;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    return createBuffer(createInfo, flags);
+}
+
+Buffer MemoryPool::createBuffer(const VkBufferCreateInfo& createInfo,
+                                VmaAllocationCreateFlags flags /* = 0 */) {
+    VmaAllocationCreateInfo allocationInfo{};
+    allocationInfo.flags = flags;
+    allocationInfo.pool = _handle;
+    return Buffer(_allocator, createInfo, allocationInfo);
+}
+
+Image MemoryPool::createImage(const VkImageCreateInfo& createInfo,
+                              VmaAllocationCreateFlags flags /* = 0 */) {
+    VmaAllocationCreateInfo allocationInfo{};
+    allocationInfo.flags = flags;
+    allocationInfo.pool = _handle;
+    return Image(_allocator, createInfo, allocationInfo);
+}
+
+VmaStatistics MemoryPool::getStatistics() const {
+    VmaStatistics statistics{};
+    vmaGetPoolStatistics(_allocator.getHandle(), _handle, &statistics);
+    return statistics;
+}
+
+TransientArena::TransientArena(MemoryPool& pool, VkDeviceSize capacity, VkBufferUsageFlags usage,
+                               VkDeviceSize alignment, uint32_t framesInFlight)
+    : _pool(pool),
+      _capacity(capacity),
+      _usage(usage),
+      _alignment(std::max<VkDeviceSize>(alignment, 16)),
+      _frames(framesInFlight) {
+}
+
+void TransientArena::beginFrame(uint32_t frameIndex) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frameIndex = frameIndex % static_cast<uint32_t>(_frames.size());
+    auto& frame = _frames[_frameIndex];
+    _statistics.peakFrameBytes = std::max(_statistics.peakFrameBytes, frame.bytes);
+    if (frame.buffers.size() > 1) {
+        // Overflowed : the next buffers hold the largest frame so far.
+        _capacity = std::max(_capacity, alignUp(frame.bytes + frame.bytes / 4, _alignment));
+        frame.buffers.clear();
+    } else if (!frame.buffers.empty() && frame.buffers.front().getSize() < _capacity) {
+        frame.buffers.clear();
+    }
+    frame.offset = 0;
+    frame.bytes = 0;
+}
+
+TransientArena::Allocation TransientArena::allocate(VkDeviceSize size,
+                                                    VkDeviceSize alignment /* = 1 */) {
+    alignment = std::max(alignment, _alignment);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& frame = _frames[_frameIndex];
+    VkDeviceSize offset = alignUp(frame.offset, alignment);
+    if (frame.buffers.empty() || offset + size > frame.buffers.back().getSize()) {
+        if (!frame.buffers.empty()) _statistics.overflows++;
+        frame.buffers.push_back(
+            _pool.createBuffer(std::max(size, _capacity), _usage,
+                               VMA_ALLOCATION_CREATE_MAPPED_BIT |
+                                   VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT));
+        offset = 0;
+    }
+    frame.offset = offset + size;
+    frame.bytes += size;
+    _statistics.allocations++;
+    _statistics.bytes += size;
+
+    auto& buffer = frame.buffers.back();
+    return {buffer.getHandle(), offset, static_cast<uint8_t*>(buffer.getMappedData()) + offset};
+}
+
+VkDeviceSize TransientArena::evict(VkDeviceSize bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& frame = _frames[_frameIndex];
+    if (frame.bytes > 0 || bytes == 0) return 0;
+    VkDeviceSize released = 0;
+    for (auto& buffer : frame.buffers) released += buffer.getSize();
+    frame.buffers.clear();
+    return released;
+}
+
+TransientArena::Statistics TransientArena::getStatistics() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _statistics;
+}
+
+StreamingCache::StreamingCache(MemoryPool& pool, VkBufferUsageFlags usage)
+    : _pool(pool), _usage(usage) {
+}
+
+void StreamingCache::beginFrame(uint64_t frame, uint64_t completedFrame) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frame = frame;
+    _completedFrame = completedFrame;
+}
+
+VkBuffer StreamingCache::find(uint64_t key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _byKey.find(key);
+    if (found == _byKey.end()) {
+        _statistics.misses++;
+        return VK_NULL_HANDLE;
+    }
+    _statistics.hits++;
+    found->second->lastFrame = _frame;
+    return found->second->buffer.getHandle();
+}
+
+VkBuffer StreamingCache::insert(uint64_t key, VkDeviceSize size) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto previous = _byKey.find(key);
+    if (previous != _byKey.end()) {
+        // Frames in flight may still read the old buffer : released once it's the oldest.
+        previous->second->stale = true;
+        _byKey.erase(previous);
+    }
+    Buffer buffer;
+    while (buffer.getHandle() == VK_NULL_HANDLE) {
+        try {
+            buffer = _pool.createBuffer(size, _usage);
+        } catch (const std::runtime_error&) {
+            VkDeviceSize released = 0;
+            if (!dropOldest(released)) throw;
+        }
+    }
+    _entries.push_back({key, std::move(buffer), _frame});
+    _byKey[key] = &_entries.back();
+    return _entries.back().buffer.getHandle();
+}
+
+VkDeviceSize StreamingCache::evict(VkDeviceSize bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    VkDeviceSize released = 0;
+    while (released < bytes) {
+        if (!dropOldest(released)) break;
+    }
+    return released;
+}
+
+StreamingCache::Statistics StreamingCache::getStatistics() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _statistics;
+}
+
+bool StreamingCache::dropOldest(VkDeviceSize& released) {
+    if (_entries.empty() || _entries.front().lastFrame > _completedFrame) return false;
+    auto& entry = _entries.front();
+    if (!entry.stale) {
+        _byKey.erase(entry.key);
+        _statistics.evictions++;
+        _statistics.evictedBytes += entry.buffer.getSize();
+    }
+    released += entry.buffer.getSize();
+    _entries.pop_front();
+    return true;
+}
+
+MemoryPools::MemoryPools(Allocator& allocator, const VkPhysicalDeviceLimits& limits,
+                         uint32_t framesInFlight) {
+    // Coherent, so that transient writes need no flush.
+    VmaAllocationCreateInfo transientInfo{};
+    transientInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    transientInfo.flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    transientInfo.requiredFlags =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    _transient = std::make_unique<MemoryPool>(
+        allocator, "transient", MemoryPool::Policy::Linear,
+        findBufferMemoryType(allocator, transientUsage, transientInfo),
+        transientCapacity * framesInFlight);
+
+    VmaAllocationCreateInfo streamingInfo{};
+    streamingInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    _streaming = std::make_unique<MemoryPool>(
+        allocator, "streaming", MemoryPool::Policy::Ring,
+        findBufferMemoryType(allocator, streamingUsage, streamingInfo), streamingBlockSize);
+
+    // Buffers and images may not accept the same memory types : one pool each.
+    VmaAllocationCreateInfo generalInfo{};
+    generalInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    _generalBuffers = std::make_unique<MemoryPool>(
+        allocator, "general buffers", MemoryPool::Policy::General,
+        findBufferMemoryType(allocator, generalBufferUsage, generalInfo));
+    _generalImages = std::make_unique<MemoryPool>(
+        allocator, "general images", MemoryPool::Policy::General,
+        findImageMemoryType(allocator, generalImageUsage, generalInfo));
+
+    VkDeviceSize alignment =
+        std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+    _transientArena = std::make_unique<TransientArena>(*_transient, transientCapacity,
+                                                       transientUsage, alignment, framesInFlight);
+    _streamingCache = std::make_unique<StreamingCache>(*_streaming, streamingUsage);
+}
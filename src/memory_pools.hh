@@ -0,0 +1,235 @@
+#pragma once
+
+#include "allocator.hh"
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// VMA custom pool : resources of one lifetime class share its memory blocks, so they never
+// fragment the default pools. Each pool uses a single memory type.
+//
+// Linear : allocations go after the last one, freed space is only reused once everything
+// after it was freed too. Ring : linear with a single block, where allocations freed in
+// creation order wrap around, for streaming. General : VMA's default algorithm, any order.
+class MemoryPool {
+public:
+    enum class Policy { Linear, Ring, General };
+
+    // blockSize 0 picks VMA's default size, maxBlockCount 0 means no limit. Ring pools
+    // have exactly one block.
+    MemoryPool(Allocator& allocator, const char* name, Policy policy, uint32_t memoryTypeIndex,
+               VkDeviceSize blockSize = 0, size_t maxBlockCount = 0);
+    ~MemoryPool();
+
+    MemoryPool(MemoryPool const&) = delete;
+    void operator=(MemoryPool const&) = delete;
+
+    VmaPool getHandle() const {
+        return _handle;
+    }
+
+    Policy getPolicy() const {
+        return _policy;
+    }
+
+    uint32_t getMemoryTypeIndex() const {
+        return _memoryTypeIndex;
+    }
+
+    uint32_t getHeapIndex() const {
+        return _heapIndex;
+    }
+
+    // Buffers are exclusive to one queue family unless createInfo says otherwise.
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                        VmaAllocationCreateFlags flags = 0);
+    Buffer createBuffer(const VkBufferCreateInfo& createInfo, VmaAllocationCreateFlags flags = 0);
+    Image createImage(const VkImageCreateInfo& createInfo, VmaAllocationCreateFlags flags = 0);
+
+    VmaStatistics getStatistics() const;
+
+private:
+    Allocator& _allocator;
+    VmaPool _handle = VK_NULL_HANDLE;
+    Policy _policy;
+    uint32_t _memoryTypeIndex;
+    uint32_t _heapIndex;
+};
+
+// Per-frame bump allocator for transient data (uniforms, per-draw constants) : one host
+// visible, coherent and persistently mapped buffer per frame in flight, carved out of a linear
+// pool. allocate() only moves an offset, and beginFrame() releases all the frame allocated
+// last time at once. Frames going past the capacity get overflow buffers, released likewise,
+// and the capacity grows to the largest frame.
+class TransientArena {
+public:
+    struct Allocation {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        void* data;
+    };
+    struct Statistics {
+        uint64_t allocations = 0;
+        VkDeviceSize bytes = 0;
+        // Largest frame, and overflow buffers created because of frames larger than capacity.
+        VkDeviceSize peakFrameBytes = 0;
+        uint64_t overflows = 0;
+    };
+
+    TransientArena(MemoryPool& pool, VkDeviceSize capacity, VkBufferUsageFlags usage,
+                   VkDeviceSize alignment, uint32_t framesInFlight);
+
+    TransientArena(TransientArena const&) = delete;
+    void operator=(TransientArena const&) = delete;
+
+    // Once the GPU is done with frame frameIndex.
+    void beginFrame(uint32_t frameIndex);
+
+    // Aligned to at least the alignment given at creation. Thread safe.
+    Allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 1);
+
+    Allocation push(const void* data, VkDeviceSize size) {
+        Allocation allocation = allocate(size);
+        std::memcpy(allocation.data, data, size);
+        return allocation;
+    }
+
+    // Releases the buffers the current frame kept from its previous use and hasn't allocated
+    // from yet, the GPU being done with them since beginFrame(). Returns the bytes released.
+    VkDeviceSize evict(VkDeviceSize bytes);
+
+    Statistics getStatistics() const;
+
+private:
+    struct Frame {
+        // Allocated on first use, the last one is being filled.
+        std::vector<Buffer> buffers;
+        VkDeviceSize offset = 0;
+        VkDeviceSize bytes = 0;
+    };
+
+    MemoryPool& _pool;
+    VkDeviceSize _capacity;
+    VkBufferUsageFlags _usage;
+    VkDeviceSize _alignment;
+    std::vector<Frame> _frames;
+    uint32_t _frameIndex = 0;
+    Statistics _statistics;
+    mutable std::mutex _mutex;
+};
+
+// Buffers of the streaming pool by key, for data its owner can upload again (streamed meshes,
+// texture data) : a missing entry is uploaded on demand. Entries are created in ring order and
+// dropped oldest first, once no frame still in flight used them, when the ring is full or the
+// budget monitor asks for memory back. Thread safe.
+class StreamingCache {
+public:
+    struct Statistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        VkDeviceSize evictedBytes = 0;
+    };
+
+    StreamingCache(MemoryPool& pool, VkBufferUsageFlags usage);
+
+    StreamingCache(StreamingCache const&) = delete;
+    void operator=(StreamingCache const&) = delete;
+
+    // Once per frame before recording, with the frame number (from 1) and the last completed.
+    void beginFrame(uint64_t frame, uint64_t completedFrame);
+
+    // Buffer of `key`, marked as used by the current frame, or VK_NULL_HANDLE when it isn't
+    // resident.
+    VkBuffer find(uint64_t key);
+
+    // New buffer for `key`, replacing its previous one, to fill before the frame uses it. Drops
+    // the oldest entries to make room, throws when those still in use leave too little.
+    VkBuffer insert(uint64_t key, VkDeviceSize size);
+
+    // Drops the oldest entries no frame in flight uses, up to `bytes`. Returns the bytes
+    // released.
+    VkDeviceSize evict(VkDeviceSize bytes);
+
+    Statistics getStatistics() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        Buffer buffer;
+        uint64_t lastFrame;
+        // Replaced by a newer entry of the same key, released once it's the oldest.
+        bool stale = false;
+    };
+
+    MemoryPool& _pool;
+    VkBufferUsageFlags _usage;
+    // Creation order, which is the ring's. Stale entries stay until they reach the front.
+    std::deque<Entry> _entries;
+    std::unordered_map<uint64_t, Entry*> _byKey;
+    uint64_t _frame = 0;
+    uint64_t _completedFrame = 0;
+    Statistics _statistics;
+    mutable std::mutex _mutex;
+
+    // Drops the front entry when no frame in flight uses it. Caller holds the lock.
+    bool dropOldest(VkDeviceSize& released);
+};
+
+// The pools of a LogicalDevice, one per lifetime class :
+// - transient : linear, host visible, behind the per-frame TransientArena;
+// - streaming : ring, device local, for data replaced oldest first, behind the StreamingCache;
+// - general buffers and general images : device local, for long-lived resources. The image
+//   pool's memory type is the one of sampled color images with optimal tiling, attachments
+//   and depth images may need another one and belong in the default pools.
+// Pools allocate no memory until their first resource.
+class MemoryPools {
+public:
+    MemoryPools(Allocator& allocator, const VkPhysicalDeviceLimits& limits,
+                uint32_t framesInFlight);
+
+    MemoryPools(MemoryPools const&) = delete;
+    void operator=(MemoryPools const&) = delete;
+
+    // Once the GPU is done with frame frameIndex, before recording frame number `frame`.
+    void beginFrame(uint32_t frameIndex, uint64_t frame, uint64_t completedFrame) {
+        _transientArena->beginFrame(frameIndex);
+        _streamingCache->beginFrame(frame, completedFrame);
+    }
+
+    TransientArena& getTransientArena() {
+        return *_transientArena;
+    }
+
+    StreamingCache& getStreamingCache() {
+        return *_streamingCache;
+    }
+
+    MemoryPool& getTransient() {
+        return *_transient;
+    }
+
+    MemoryPool& getStreaming() {
+        return *_streaming;
+    }
+
+    MemoryPool& getGeneralBuffers() {
+        return *_generalBuffers;
+    }
+
+    MemoryPool& getGeneralImages() {
+        return *_generalImages;
+    }
+
+private:
+    std::unique_ptr<MemoryPool> _transient;
+    std::unique_ptr<MemoryPool> _streaming;
+    std::unique_ptr<MemoryPool> _generalBuffers;
+    std::unique_ptr<MemoryPool> _generalImages;
+    std::unique_ptr<TransientArena> _transientArena;
+    std::unique_ptr<StreamingCache> _streamingCache;
+};
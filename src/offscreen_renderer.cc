@@ -0,0 +1,168 @@
+#include "offscreen_renderer.hh"
+
+OffscreenRenderer::OffscreenRenderer(LogicalDevice& device, VkExtent2D extent,
+                                     VkFormat format /* = VK_FORMAT_R8G8B8A8_UNORM */,
+                                     VkDeviceSize texelSize /* = 4 */)
+    : _device(device),
+      _queue(device.getQueue(QueueRole::Graphics)),
+      _extent(extent),
+      _format(format),
+      _frameSize(VkDeviceSize(extent.width) * extent.height * texelSize) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = _queue.getFamilyIndex();
+    if (vkCreateCommandPool(_device.getHandle(), &poolInfo, nullptr, &_commandPool) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to create offscreen command pool.");
+    }
+
+    _slots.resize(LogicalDevice::maxFramesInFlight);
+    for (auto& slot : _slots) {
+        slot.image = Image(device.getAllocator(), extent, format,
+                           VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                               VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                           1, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+        slot.readback = Buffer(device.getAllocator(), _frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                               VMA_MEMORY_USAGE_AUTO,
+                               VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+                                   VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = _commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(_device.getHandle(), &allocInfo, &slot.commandBuffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate offscreen command buffer.");
+        }
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(_device.getHandle(), &fenceInfo, nullptr, &slot.fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create offscreen fence.");
+        }
+    }
+    std::cerr << "Offscreen renderer successfully created (" << extent.width << "x"
+              << extent.height << ", " << _slots.size() << " frames in flight).\n";
+}
+
+OffscreenRenderer::~OffscreenRenderer() {
+    for (auto& slot : _slots) {
+        waitSlot(slot);
+        vkDestroyFence(_device.getHandle(), slot.fence, nullptr);
+    }
+    vkDestroyCommandPool(_device.getHandle(), _commandPool, nullptr);
+    std::cerr << "Destroyed offscreen renderer.\n";
+}
+
+uint64_t OffscreenRenderer::render(const RecordFunction& record) {
+    uint64_t frame = _nextFrame++;
+    uint32_t slotIndex = static_cast<uint32_t>(frame % _slots.size());
+    auto& slot = _slots[slotIndex];
+    waitSlot(slot);
+    // Numbered from 1 there : the frames up to the previous one of this slot have completed.
+    uint64_t completed = frame >= _slots.size() ? frame + 1 - _slots.size() : 0;
+    _device.getMemoryPools().beginFrame(slotIndex, frame + 1, completed);
+    _device.getBudgetMonitor().update(frame);
+    _device.getDefragmenter().update(frame + 1, completed);
+    for (size_t role = 0; role < queueRoleCount; role++) {
+        _device.getCommandPools(static_cast<QueueRole>(role)).beginFrame(slotIndex);
+    }
+    if (auto* bindlessTable = _device.getBindlessTable()) bindlessTable->beginFrame(slotIndex);
+
+    VkCommandBuffer cmd = slot.commandBuffer;
+    vkResetCommandBuffer(cmd, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(cmd, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin offscreen command buffer.");
+    }
+    auto& profiler = _device.getProfiler();
+    profiler.beginFrame(cmd, slotIndex);
+    uint32_t frameZone = profiler.beginZone(cmd, QueueRole::Graphics, "offscreen frame");
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = slot.image.getHandle();
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT |
+                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    {
+        GpuZone zone(profiler, cmd, QueueRole::Graphics, "record");
+        record(cmd, slot.image);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = slot.image.getExtent();
+    {
+        GpuZone zone(profiler, cmd, QueueRole::Graphics, "readback copy");
+        vkCmdCopyImageToBuffer(cmd, slot.image.getHandle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               slot.readback.getHandle(), 1, &region);
+    }
+
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = slot.readback.getHandle();
+    hostBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+                         nullptr, 1, &hostBarrier, 0, nullptr);
+    profiler.endZone(cmd, frameZone);
+
+    if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record offscreen command buffer.");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    vkResetFences(_device.getHandle(), 1, &slot.fence);
+    if (_queue.submit(1, &submitInfo, slot.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit offscreen frame.");
+    }
+    slot.frame = frame;
+    slot.pending = true;
+    return frame;
+}
+
+const uint8_t* OffscreenRenderer::readback(uint64_t frame) {
+    auto& slot = _slots[frame % _slots.size()];
+    if (slot.frame != frame) {
+        throw std::runtime_error("Offscreen frame already overwritten.");
+    }
+    waitSlot(slot);
+    // Readback memory may be cached but not coherent.
+    vmaInvalidateAllocation(_device.getAllocator().getHandle(), slot.readback.getAllocation(), 0,
+                            VK_WHOLE_SIZE);
+    return static_cast<const uint8_t*>(slot.readback.getMappedData());
+}
+
+void OffscreenRenderer::waitSlot(Slot& slot) {
+    if (!slot.pending) return;
+    vkWaitForFences(_device.getHandle(), 1, &slot.fence, VK_TRUE, UINT64_MAX);
+    slot.pending = false;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "application.hh"
+
+#include <functional>
+#include <vector>
+
+// Renders into device-local images and copies every frame back to host memory, without any
+// window or surface. Frames rotate over maxFramesInFlight slots : the GPU renders the next
+// frames while the caller reads the previous ones.
+class OffscreenRenderer {
+public:
+    // Records the frame into the image, which is in VK_IMAGE_LAYOUT_GENERAL and must be left
+    // in it. Its previous contents are undefined.
+    using RecordFunction = std::function<void(VkCommandBuffer, const Image&)>;
+
+    OffscreenRenderer(LogicalDevice& device, VkExtent2D extent,
+                      VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, VkDeviceSize texelSize = 4);
+    ~OffscreenRenderer();
+
+    OffscreenRenderer(OffscreenRenderer const&) = delete;
+    void operator=(OffscreenRenderer const&) = delete;
+
+    // Submits a frame on the graphics queue and returns its number. Blocks only when the slot
+    // it reuses still holds a frame the GPU hasn't finished.
+    uint64_t render(const RecordFunction& record);
+
+    // Waits for the frame and returns its tightly packed pixels, valid until the slot is
+    // reused by a later render().
+    const uint8_t* readback(uint64_t frame);
+
+    VkExtent2D getExtent() const {
+        return _extent;
+    }
+
+    VkFormat getFormat() const {
+        return _format;
+    }
+
+    VkDeviceSize getFrameSize() const {
+        return _frameSize;
+    }
+
+private:
+    struct Slot {
+        Image image;
+        Buffer readback;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        uint64_t frame = 0;
+        bool pending = false;
+    };
+
+    LogicalDevice& _device;
+    Queue& _queue;
+    VkExtent2D _extent;
+    VkFormat _format;
+    VkDeviceSize _frameSize;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+    std::vector<Slot> _slots;
+    uint64_t _nextFrame = 1;
+
+    void waitSlot(Slot& slot);
+};
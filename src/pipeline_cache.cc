@@ -0,0 +1,84 @@
+#include "pipeline_cache.hh"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+PipelineCache::PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties,
+                             const std::string& path)
+    : _device(device), _path(path) {
+    std::vector<char> data;
+    std::ifstream file(_path, std::ios::binary);
+    if (file) {
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (!isCompatible(data, properties)) {
+            std::cerr << "Discarding pipeline cache " << _path << " : built for another device.\n";
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(_device, &createInfo, nullptr, &_handle) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache.");
+    }
+    _warm = !data.empty();
+    std::cerr << "Pipeline cache successfully created (" << data.size() << " bytes loaded).\n";
+}
+
+PipelineCache::~PipelineCache() {
+    try {
+        save();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+    }
+    vkDestroyPipelineCache(_device, _handle, nullptr);
+    std::cerr << "Destroyed pipeline cache.\n";
+}
+
+void PipelineCache::save() const {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(_device, _handle, &size, nullptr) != VK_SUCCESS || size == 0) return;
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(_device, _handle, &size, data.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to read back pipeline cache data.");
+    }
+
+    std::string tmpPath = _path + ".tmp";
+    FILE* file = std::fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Failed to open " + tmpPath + " for writing.");
+    }
+    bool written = std::fwrite(data.data(), 1, size, file) == size && std::fflush(file) == 0 &&
+                   fsync(fileno(file)) == 0;
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(tmpPath.c_str(), _path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("Failed to write pipeline cache " + _path + ".");
+    }
+}
+
+std::string PipelineCache::defaultPath(const VkPhysicalDeviceProperties& properties) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "pipeline_cache_%04x_%04x.bin", properties.vendorID,
+                  properties.deviceID);
+    return name;
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data,
+                                 const VkPhysicalDeviceProperties& properties) {
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header)) return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+           std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+
+// VkPipelineCache persisted on disk between runs. The file is only reused when its header
+// matches the vendorID, deviceID and pipelineCacheUUID of the device, so a driver update or
+// another GPU silently starts from an empty cache instead of feeding the driver stale data.
+class PipelineCache {
+public:
+    PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties,
+                  const std::string& path);
+    ~PipelineCache();
+
+    PipelineCache(PipelineCache const&) = delete;
+    void operator=(PipelineCache const&) = delete;
+
+    VkPipelineCache getHandle() const {
+        return _handle;
+    }
+
+    const std::string& getPath() const {
+        return _path;
+    }
+
+    // True when valid data from a previous run was handed to the driver.
+    bool isWarm() const {
+        return _warm;
+    }
+
+    // Writes the cache to a temporary file and renames it over the previous one, so a crash
+    // mid-write never leaves a truncated cache behind.
+    void save() const;
+
+    static std::string defaultPath(const VkPhysicalDeviceProperties& properties);
+
+private:
+    VkDevice _device;
+    VkPipelineCache _handle = VK_NULL_HANDLE;
+    std::string _path;
+    bool _warm = false;
+
+    static bool isCompatible(const std::vector<char>& data,
+                             const VkPhysicalDeviceProperties& properties);
+};
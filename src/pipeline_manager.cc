@@ -0,0 +1,188 @@
+#include "pipeline_manager.hh"
+
+#include <chrono>
+#include <iostream>
+
+PipelineManager::PipelineManager(LogicalDevice& device,
+                                 uint32_t threadCount /* = defaultThreadCount() */)
+    : _device(device), _jobs(std::max(1u, threadCount)) {
+    std::cerr << "Pipeline manager successfully created (" << _jobs.getWorkerCount()
+              << " compile threads).\n";
+}
+
+PipelineManager::~PipelineManager() {
+    waitIdle();
+    for (auto& pending : _pipelines) {
+        if (pending->_pipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(_device.getHandle(), pending->_pipeline, nullptr);
+        }
+    }
+    std::cerr << "Destroyed pipeline manager.\n";
+}
+
+PendingPipeline& PipelineManager::requestGraphics(GraphicsPipelineDescription description,
+                                                  VkPipeline fallback /* = VK_NULL_HANDLE */) {
+    return request(
+        [description = std::move(description)](VkDevice device, VkPipelineCache cache) {
+            VkPipelineVertexInputStateCreateInfo vertexInput{};
+            vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+            vertexInput.vertexBindingDescriptionCount =
+                static_cast<uint32_t>(description.vertexBindings.size());
+            vertexInput.pVertexBindingDescriptions = description.vertexBindings.data();
+            vertexInput.vertexAttributeDescriptionCount =
+                static_cast<uint32_t>(description.vertexAttributes.size());
+            vertexInput.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+            VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+            inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+            inputAssembly.topology = description.topology;
+
+            VkPipelineViewportStateCreateInfo viewport{};
+            viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+            viewport.viewportCount = 1;
+            viewport.scissorCount = 1;
+
+            VkPipelineRasterizationStateCreateInfo rasterization{};
+            rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+            rasterization.polygonMode = description.polygonMode;
+            rasterization.cullMode = description.cullMode;
+            rasterization.frontFace = description.frontFace;
+            rasterization.lineWidth = 1.0f;
+
+            VkPipelineMultisampleStateCreateInfo multisample{};
+            multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+            multisample.rasterizationSamples = description.samples;
+
+            VkPipelineDepthStencilStateCreateInfo depthStencil{};
+            depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+            depthStencil.depthTestEnable = description.depthTest;
+            depthStencil.depthWriteEnable = description.depthWrite;
+            depthStencil.depthCompareOp = description.depthCompareOp;
+
+            VkPipelineColorBlendStateCreateInfo colorBlend{};
+            colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+            colorBlend.attachmentCount = static_cast<uint32_t>(description.blendAttachments.size());
+            colorBlend.pAttachments = description.blendAttachments.data();
+
+            std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+                                                         VK_DYNAMIC_STATE_SCISSOR};
+            dynamicStates.insert(dynamicStates.end(), description.extraDynamicStates.begin(),
+                                 description.extraDynamicStates.end());
+            VkPipelineDynamicStateCreateInfo dynamic{};
+            dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+            dynamic.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+            dynamic.pDynamicStates = dynamicStates.data();
+
+            auto stages = description.stages;
+            std::vector<VkSpecializationInfo> specializations;
+            for (auto& specialization : description.specializations) {
+                specializations.push_back(specialization.getInfo());
+            }
+            for (size_t i = 0; i < specializations.size() && i < stages.size(); i++) {
+                stages[i].pSpecializationInfo =
+                    description.specializations[i].empty() ? nullptr : &specializations[i];
+            }
+
+            VkGraphicsPipelineCreateInfo pipelineInfo{};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+            pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+            pipelineInfo.pStages = stages.data();
+            pipelineInfo.pVertexInputState = &vertexInput;
+            pipelineInfo.pInputAssemblyState = &inputAssembly;
+            pipelineInfo.pViewportState = &viewport;
+            pipelineInfo.pRasterizationState = &rasterization;
+            pipelineInfo.pMultisampleState = &multisample;
+            pipelineInfo.pDepthStencilState = &depthStencil;
+            pipelineInfo.pColorBlendState = &colorBlend;
+            pipelineInfo.pDynamicState = &dynamic;
+            pipelineInfo.layout = description.layout;
+            pipelineInfo.renderPass = description.renderPass;
+            pipelineInfo.subpass = description.subpass;
+
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+            return pipeline;
+        },
+        fallback);
+}
+
+PendingPipeline& PipelineManager::requestCompute(VkShaderModule module, VkPipelineLayout layout,
+                                                 VkPipeline fallback /* = VK_NULL_HANDLE */,
+                                                 const char* entryPoint /* = "main" */,
+                                                 Specialization specialization /* = {} */) {
+    return request(
+        [module, layout, entryPoint, specialization = std::move(specialization)](
+            VkDevice device, VkPipelineCache cache) {
+            VkSpecializationInfo specializationInfo = specialization.getInfo();
+            VkComputePipelineCreateInfo pipelineInfo{};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            pipelineInfo.stage.module = module;
+            pipelineInfo.stage.pName = entryPoint;
+            if (!specialization.empty()) {
+                pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+            }
+            pipelineInfo.layout = layout;
+
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            vkCreateComputePipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+            return pipeline;
+        },
+        fallback);
+}
+
+PendingPipeline& PipelineManager::request(CreateFunction create,
+                                          VkPipeline fallback /* = VK_NULL_HANDLE */) {
+    PendingPipeline* pending;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pipelines.push_back(std::make_unique<PendingPipeline>());
+        pending = _pipelines.back().get();
+        _statistics.requested++;
+    }
+    pending->_fallback = fallback;
+    _jobs.schedule([this, pending, create = std::move(create)]() { compile(*pending, create); },
+                   &_pending);
+    return *pending;
+}
+
+void PipelineManager::waitIdle() {
+    _jobs.wait(_pending);
+}
+
+PipelineManager::Statistics PipelineManager::getStatistics() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _statistics;
+}
+
+void PipelineManager::compile(PendingPipeline& pending, const CreateFunction& create) {
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+        pipeline = create(_device.getHandle(), _device.getPipelineCache().getHandle());
+    } catch (const std::exception& e) {
+        // Thrown on a worker, nobody would catch it : report and fall back for good.
+        std::cerr << "Pipeline compilation failed: " << e.what() << "\n";
+    }
+    double milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+
+    pending._pipeline = pipeline;
+    pending._compileMilliseconds = milliseconds;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (pipeline != VK_NULL_HANDLE) {
+            _statistics.compiled++;
+            _statistics.totalCompileMilliseconds += milliseconds;
+            _statistics.maxCompileMilliseconds =
+                std::max(_statistics.maxCompileMilliseconds, milliseconds);
+        } else {
+            _statistics.failed++;
+        }
+    }
+    pending._state.store(pipeline != VK_NULL_HANDLE ? PendingPipeline::State::Ready
+                                                    : PendingPipeline::State::Failed,
+                         std::memory_order_release);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "application.hh"
+#include "job_system.hh"
+
+// Specialization constant values of one stage, owned like the descriptions below.
+struct Specialization {
+    std::vector<VkSpecializationMapEntry> entries;
+    std::vector<uint8_t> data;
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    // Points into this object, valid as long as it isn't modified.
+    VkSpecializationInfo getInfo() const {
+        return {static_cast<uint32_t>(entries.size()), entries.data(), data.size(), data.data()};
+    }
+};
+
+// Fixed function state and shaders of a graphics pipeline, owned by value so it can be built
+// on another thread after the caller's locals are gone. Shader modules, layout and render
+// pass must stay alive until the pipeline is ready; entry point names must be literals.
+struct GraphicsPipelineDescription {
+    std::vector<VkPipelineShaderStageCreateInfo> stages;
+    // Empty, or one per stage. Takes over the stages' pSpecializationInfo.
+    std::vector<Specialization> specializations;
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    bool depthTest = false;
+    bool depthWrite = false;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    // One per color attachment of the subpass.
+    std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+    // Viewport and scissor are always dynamic.
+    std::vector<VkDynamicState> extraDynamicStates;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+};
+
+// Pipeline being compiled in the background. get() returns the fallback until the real
+// pipeline is ready, then the real one; renderers call it every time they bind instead of
+// keeping the result. A null fallback means "skip the draw until ready".
+class PendingPipeline {
+public:
+    enum class State { Compiling, Ready, Failed };
+
+    VkPipeline get() const {
+        return isReady() ? _pipeline : _fallback;
+    }
+
+    bool isReady() const {
+        return getState() == State::Ready;
+    }
+
+    State getState() const {
+        return _state.load(std::memory_order_acquire);
+    }
+
+    VkPipeline getFallback() const {
+        return _fallback;
+    }
+
+    // Time spent in vkCreate*Pipelines, valid once no longer compiling.
+    double getCompileMilliseconds() const {
+        return _compileMilliseconds;
+    }
+
+private:
+    friend class PipelineManager;
+
+    VkPipeline _pipeline = VK_NULL_HANDLE;
+    VkPipeline _fallback = VK_NULL_HANDLE;
+    double _compileMilliseconds = 0.0;
+    // Published last with a release store, so readers seeing Ready also see _pipeline.
+    std::atomic<State> _state{State::Compiling};
+};
+
+// Compiles pipelines on its own background threads, all sharing the device's VkPipelineCache,
+// so a material showing up mid-frame never blocks the render thread on the driver's compiler.
+// The threads are separate from the frame's JobSystem so long compiles don't delay recording.
+// Pipelines, including failed requests, live as long as the manager; fallbacks are owned by
+// the caller.
+class PipelineManager {
+public:
+    struct Statistics {
+        uint64_t requested = 0;
+        uint64_t compiled = 0;
+        uint64_t failed = 0;
+        double totalCompileMilliseconds = 0.0;
+        double maxCompileMilliseconds = 0.0;
+    };
+
+    using CreateFunction = std::function<VkPipeline(VkDevice, VkPipelineCache)>;
+
+    explicit PipelineManager(LogicalDevice& device, uint32_t threadCount = defaultThreadCount());
+    ~PipelineManager();
+
+    PipelineManager(PipelineManager const&) = delete;
+    void operator=(PipelineManager const&) = delete;
+
+    // All requests return at once. The reference stays valid for the manager's lifetime.
+    PendingPipeline& requestGraphics(GraphicsPipelineDescription description,
+                                     VkPipeline fallback = VK_NULL_HANDLE);
+    PendingPipeline& requestCompute(VkShaderModule module, VkPipelineLayout layout,
+                                    VkPipeline fallback = VK_NULL_HANDLE,
+                                    const char* entryPoint = "main",
+                                    Specialization specialization = {});
+    // `create` runs on a background thread, returns VK_NULL_HANDLE or throws on failure.
+    PendingPipeline& request(CreateFunction create, VkPipeline fallback = VK_NULL_HANDLE);
+
+    // Blocks until every request made so far is done, e.g. behind a loading screen.
+    void waitIdle();
+
+    // No request is compiling.
+    bool isIdle() const {
+        return _pending.isDone();
+    }
+
+    Statistics getStatistics() const;
+
+    static uint32_t defaultThreadCount() {
+        return std::max(1u, std::thread::hardware_concurrency() / 4);
+    }
+
+private:
+    LogicalDevice& _device;
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<PendingPipeline>> _pipelines;
+    Statistics _statistics;
+    JobCounter _pending;
+    // Last, so its workers are joined before anything they touch is destroyed.
+    JobSystem _jobs;
+
+    void compile(PendingPipeline& pending, const CreateFunction& create);
+};
@@ -0,0 +1,93 @@
+#include "pipeline_variants.hh"
+
+#include <algorithm>
+#include <cstring>
+
+PipelineVariants::PipelineVariants(PipelineManager& manager,
+                                   GraphicsPipelineDescription description,
+                                   std::vector<ShaderReflection> stages,
+                                   VkPipeline fallback /* = VK_NULL_HANDLE */)
+    : _manager(manager),
+      _compute(false),
+      _description(std::move(description)),
+      _stages(std::move(stages)),
+      _fallback(fallback) {
+    // The default permutation is compiled right away, it's every other variant's fallback.
+    _default = &get();
+}
+
+PipelineVariants::PipelineVariants(PipelineManager& manager, VkShaderModule module,
+                                   ShaderReflection reflection, VkPipelineLayout layout,
+                                   VkPipeline fallback /* = VK_NULL_HANDLE */,
+                                   const char* entryPoint /* = "main" */)
+    : _manager(manager),
+      _compute(true),
+      _module(module),
+      _layout(layout),
+      _entryPoint(entryPoint),
+      _fallback(fallback) {
+    _stages.push_back(std::move(reflection));
+    _default = &get();
+}
+
+PendingPipeline& PipelineVariants::get(const Permutation& permutation /* = {} */) {
+    Key key = normalize(permutation);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _variants.find(key);
+    if (found != _variants.end()) return *found->second;
+    auto& pending = request(key);
+    _variants.emplace(std::move(key), &pending);
+    return pending;
+}
+
+size_t PipelineVariants::getVariantCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _variants.size();
+}
+
+PipelineVariants::Key PipelineVariants::normalize(const Permutation& permutation) const {
+    Key key;
+    for (auto& value : permutation) {
+        for (auto& stage : _stages) {
+            auto& constants = stage.specializationConstants;
+            auto constant = std::find_if(constants.begin(), constants.end(),
+                                         [&](const ShaderReflection::SpecializationConstant& c) {
+                                             return c.id == value.first;
+                                         });
+            if (constant == constants.end()) continue;
+            uint64_t bits = value.second;
+            if (constant->size < sizeof(bits)) bits &= (1ull << (8 * constant->size)) - 1;
+            if (bits != constant->defaultValue) key.emplace_back(value.first, bits);
+            break;
+        }
+    }
+    // Permutation is ordered by id, so is the key.
+    return key;
+}
+
+PendingPipeline& PipelineVariants::request(const Key& key) {
+    std::vector<Specialization> specializations(_stages.size());
+    for (size_t i = 0; i < _stages.size(); i++) {
+        auto& specialization = specializations[i];
+        for (auto& constant : _stages[i].specializationConstants) {
+            auto value = std::find_if(key.begin(), key.end(), [&](const Key::value_type& entry) {
+                return entry.first == constant.id;
+            });
+            if (value == key.end()) continue;
+            uint32_t offset = static_cast<uint32_t>(specialization.data.size());
+            specialization.entries.push_back({constant.id, offset, constant.size});
+            specialization.data.resize(offset + constant.size);
+            // Little endian : the low bytes hold the value whatever its size.
+            std::memcpy(specialization.data.data() + offset, &value->second, constant.size);
+        }
+    }
+
+    VkPipeline fallback = _default && _default->isReady() ? _default->get() : _fallback;
+    if (_compute) {
+        return _manager.requestCompute(_module, _layout, fallback, _entryPoint,
+                                       std::move(specializations[0]));
+    }
+    auto description = _description;
+    description.specializations = std::move(specializations);
+    return _manager.requestGraphics(std::move(description), fallback);
+}
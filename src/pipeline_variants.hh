@@ -0,0 +1,56 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "pipeline_manager.hh"
+#include "spirv_reflection.hh"
+
+// Variants of one pipeline differing only by specialization constants : one SPIR-V module per
+// stage, one pipeline per permutation, and the driver folds the feature branches away.
+// Permutations are normalized before lookup, dropping constants no stage declares and values
+// equal to the shader's default, so toggles a shader ignores never create a new variant.
+// While a variant compiles, the default permutation's pipeline is its fallback if it's ready.
+class PipelineVariants {
+public:
+    // Values by specialization constant id, booleans being 0 or 1.
+    using Permutation = std::map<uint32_t, uint64_t>;
+
+    // `stages` reflects description.stages one to one. Entry point names must be literals.
+    PipelineVariants(PipelineManager& manager, GraphicsPipelineDescription description,
+                     std::vector<ShaderReflection> stages, VkPipeline fallback = VK_NULL_HANDLE);
+    PipelineVariants(PipelineManager& manager, VkShaderModule module, ShaderReflection reflection,
+                     VkPipelineLayout layout, VkPipeline fallback = VK_NULL_HANDLE,
+                     const char* entryPoint = "main");
+
+    PipelineVariants(PipelineVariants const&) = delete;
+    void operator=(PipelineVariants const&) = delete;
+
+    // Requests the variant on first use, then returns the same pending pipeline.
+    PendingPipeline& get(const Permutation& permutation = {});
+
+    size_t getVariantCount() const;
+
+private:
+    using Key = std::vector<std::pair<uint32_t, uint64_t>>;
+
+    PipelineManager& _manager;
+    bool _compute;
+    GraphicsPipelineDescription _description;
+    VkShaderModule _module = VK_NULL_HANDLE;
+    VkPipelineLayout _layout = VK_NULL_HANDLE;
+    const char* _entryPoint = "main";
+    std::vector<ShaderReflection> _stages;
+    VkPipeline _fallback;
+    mutable std::mutex _mutex;
+    std::map<Key, PendingPipeline*> _variants;
+    PendingPipeline* _default = nullptr;
+
+    Key normalize(const Permutation& permutation) const;
+    PendingPipeline& request(const Key& key);
+};
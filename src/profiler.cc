@@ -0,0 +1,206 @@
+#include "profiler.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// Trace thread ids : GPU queues come first, CPU threads get theirs on first use.
+static constexpr uint32_t firstCpuThread = queueRoleCount;
+static std::atomic<uint32_t> nextCpuThread{firstCpuThread};
+static const char* roleNames[queueRoleCount] = {"GPU graphics", "GPU compute", "GPU transfer"};
+
+static uint32_t cpuThreadId() {
+    static thread_local uint32_t id = nextCpuThread.fetch_add(1);
+    return id;
+}
+
+static void writeEscaped(std::ostream& stream, const char* text) {
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') stream << '\\';
+        stream << *text;
+    }
+}
+
+Profiler::Profiler(VkDevice device, const VkPhysicalDeviceProperties& properties,
+                   const std::vector<VkQueueFamilyProperties>& familyProperties,
+                   const std::array<uint32_t, queueRoleCount>& roleFamilies,
+                   uint32_t framesInFlight, uint32_t maxZonesPerFrame /* = 256 */)
+    : _device(device),
+      _timestampPeriod(properties.limits.timestampPeriod),
+      _maxZones(maxZonesPerFrame),
+      _frames(framesInFlight),
+      _epoch(std::chrono::steady_clock::now()) {
+    for (size_t role = 0; role < queueRoleCount; role++) {
+        uint32_t validBits = familyProperties[roleFamilies[role]].timestampValidBits;
+        _supported[role] = validBits > 0;
+        _timestampMasks[role] = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    }
+
+    for (auto& frame : _frames) {
+        frame.zones.resize(_maxZones);
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = 2 * _maxZones;
+        if (vkCreateQueryPool(_device, &poolInfo, nullptr, &frame.pool) != VK_SUCCESS) {
+            for (auto& created : _frames) {
+                if (created.pool != VK_NULL_HANDLE) {
+                    vkDestroyQueryPool(_device, created.pool, nullptr);
+                }
+            }
+            throw std::runtime_error("Failed to create timestamp query pool.");
+        }
+    }
+    std::cerr << "Profiler successfully created (timestamp period " << _timestampPeriod
+              << " ns).\n";
+}
+
+Profiler::~Profiler() {
+    for (auto& frame : _frames) vkDestroyQueryPool(_device, frame.pool, nullptr);
+}
+
+void Profiler::beginFrame(VkCommandBuffer cmd, uint32_t frameIndex) {
+    frameIndex %= _frames.size();
+    auto& frame = _frames[frameIndex];
+    collect(frame);
+    vkCmdResetQueryPool(cmd, frame.pool, 0, 2 * _maxZones);
+    frame.zoneCount.store(0, std::memory_order_relaxed);
+    frame.cpuStart = std::chrono::steady_clock::now();
+    frame.recorded = true;
+    _frameIndex.store(frameIndex, std::memory_order_release);
+}
+
+uint32_t Profiler::beginZone(VkCommandBuffer cmd, QueueRole role, const char* name) {
+    if (!isSupported(role)) return invalidZone;
+    auto& frame = _frames[_frameIndex.load(std::memory_order_acquire)];
+    uint32_t zone = frame.zoneCount.fetch_add(1, std::memory_order_relaxed);
+    if (zone >= _maxZones) return invalidZone;
+    frame.zones[zone] = {name, role};
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.pool, 2 * zone);
+    return zone;
+}
+
+void Profiler::endZone(VkCommandBuffer cmd, uint32_t zone) {
+    if (zone == invalidZone) return;
+    auto& frame = _frames[_frameIndex.load(std::memory_order_acquire)];
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.pool, 2 * zone + 1);
+}
+
+void Profiler::addCpuZone(const char* name, std::chrono::steady_clock::time_point start,
+                          std::chrono::steady_clock::time_point end) {
+    if (!isCapturing()) return;
+    double begin = toMicroseconds(start);
+    uint32_t thread = cpuThreadId();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.push_back({name, thread, begin, toMicroseconds(end) - begin});
+}
+
+void Profiler::addCounter(const std::string& name,
+                          const std::vector<std::pair<const char*, double>>& series) {
+    if (!isCapturing()) return;
+    double time = toMicroseconds(std::chrono::steady_clock::now());
+    std::lock_guard<std::mutex> lock(_mutex);
+    _counters.push_back({name, time, series});
+}
+
+std::vector<Profiler::ZoneTiming> Profiler::getLastFrameTimings() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _lastFrame;
+}
+
+void Profiler::writeChromeTrace(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) throw std::runtime_error("Can't open " + path + ".");
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    uint32_t lastCpuThread = nextCpuThread.load();
+    for (uint32_t thread = 0; thread < lastCpuThread; thread++) {
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread
+             << ",\"args\":{\"name\":\"";
+        if (thread < firstCpuThread) {
+            file << roleNames[thread];
+        } else {
+            file << "CPU " << thread - firstCpuThread;
+        }
+        file << "\"}}"
+             << (thread + 1 < lastCpuThread || !_events.empty() || !_counters.empty() ? ",\n"
+                                                                                   : "\n");
+    }
+    for (size_t i = 0; i < _events.size(); i++) {
+        auto& event = _events[i];
+        file << "{\"name\":\"";
+        writeEscaped(file, event.name);
+        file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread << ",\"ts\":" << event.start
+             << ",\"dur\":" << event.duration << "}"
+             << (i + 1 < _events.size() || !_counters.empty() ? ",\n" : "\n");
+    }
+    for (size_t i = 0; i < _counters.size(); i++) {
+        auto& counter = _counters[i];
+        file << "{\"name\":\"";
+        writeEscaped(file, counter.name.c_str());
+        file << "\",\"ph\":\"C\",\"pid\":0,\"ts\":" << counter.time << ",\"args\":{";
+        for (size_t j = 0; j < counter.series.size(); j++) {
+            file << (j > 0 ? ",\"" : "\"");
+            writeEscaped(file, counter.series[j].first);
+            file << "\":" << counter.series[j].second;
+        }
+        file << "}}" << (i + 1 < _counters.size() ? ",\n" : "\n");
+    }
+    file << "]}\n";
+}
+
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.clear();
+    _counters.clear();
+}
+
+void Profiler::collect(FrameQueries& frame) {
+    if (!frame.recorded) return;
+    uint32_t zoneCount = std::min(frame.zoneCount.load(std::memory_order_relaxed), _maxZones);
+    if (zoneCount == 0) return;
+
+    // Per query : the timestamp then its availability, so zones never closed are skipped
+    // instead of failing the whole read.
+    std::vector<uint64_t> results(4 * zoneCount);
+    vkGetQueryPoolResults(_device, frame.pool, 0, 2 * zoneCount, results.size() * sizeof(uint64_t),
+                          results.data(), 2 * sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    struct Measured {
+        Zone zone;
+        uint64_t begin;
+        uint64_t ticks;
+    };
+    std::vector<Measured> measured;
+    uint64_t base = ~0ull;
+    for (uint32_t zone = 0; zone < zoneCount; zone++) {
+        const uint64_t* query = &results[4 * zone];
+        if (query[1] == 0 || query[3] == 0) continue;
+        auto role = static_cast<size_t>(frame.zones[zone].role);
+        uint64_t mask = _timestampMasks[role];
+        uint64_t begin = query[0] & mask;
+        uint64_t ticks = ((query[2] & mask) - begin) & mask;
+        measured.push_back({frame.zones[zone], begin, ticks});
+        base = std::min(base, begin);
+    }
+
+    double frameStart = toMicroseconds(frame.cpuStart);
+    double microsecondsPerTick = _timestampPeriod / 1000.0;
+    bool capturing = isCapturing();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lastFrame.clear();
+    for (auto& zone : measured) {
+        double duration = zone.ticks * microsecondsPerTick;
+        _lastFrame.push_back({zone.zone.name, zone.zone.role, duration / 1000.0});
+        if (!capturing) continue;
+        _events.push_back({zone.zone.name, static_cast<uint32_t>(zone.zone.role),
+                           frameStart + (zone.begin - base) * microsecondsPerTick, duration});
+    }
+}
+
+double Profiler::toMicroseconds(std::chrono::steady_clock::time_point time) const {
+    return std::chrono::duration<double, std::micro>(time - _epoch).count();
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "queue.hh"
+
+// GPU zones measured with timestamp queries, one query pool per frame in flight, plus CPU
+// zones, both exported as a Chrome trace (chrome://tracing, Perfetto).
+//
+// Contract : beginFrame(cmd, i) runs once the GPU is done with frame i, with a command buffer
+// executed before any other of the frame. Zone names must outlive the profiler (literals).
+// Zones on a queue family without timestamp support (timestampValidBits == 0) are no-ops.
+// Zones and counters only go to the trace while capturing, so that a process never capturing
+// doesn't accumulate them. getLastFrameTimings() works either way.
+class Profiler {
+public:
+    static constexpr uint32_t invalidZone = ~0u;
+
+    struct ZoneTiming {
+        const char* name;
+        QueueRole role;
+        double milliseconds;
+    };
+
+    Profiler(VkDevice device, const VkPhysicalDeviceProperties& properties,
+             const std::vector<VkQueueFamilyProperties>& familyProperties,
+             const std::array<uint32_t, queueRoleCount>& roleFamilies, uint32_t framesInFlight,
+             uint32_t maxZonesPerFrame = 256);
+    ~Profiler();
+
+    Profiler(Profiler const&) = delete;
+    void operator=(Profiler const&) = delete;
+
+    // Collects the timings frame i recorded last time, then resets its queries in cmd.
+    void beginFrame(VkCommandBuffer cmd, uint32_t frameIndex);
+
+    uint32_t beginZone(VkCommandBuffer cmd, QueueRole role, const char* name);
+    void endZone(VkCommandBuffer cmd, uint32_t zone);
+
+    void addCpuZone(const char* name, std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end);
+
+    // Samples a counter track of the trace, one value per named series (names are literals).
+    void addCounter(const std::string& name,
+                    const std::vector<std::pair<const char*, double>>& series);
+
+    // Off at creation.
+    void setCapturing(bool capturing) {
+        _capturing.store(capturing, std::memory_order_relaxed);
+    }
+
+    bool isCapturing() const {
+        return _capturing.load(std::memory_order_relaxed);
+    }
+
+    bool isSupported(QueueRole role) const {
+        return _supported[static_cast<size_t>(role)];
+    }
+
+    // GPU zones of the most recently collected frame.
+    std::vector<ZoneTiming> getLastFrameTimings() const;
+
+    // Writes every zone captured since the last clear(). GPU zones are placed relative to the
+    // CPU time their frame began : durations are exact, offsets to CPU zones approximate.
+    void writeChromeTrace(const std::string& path) const;
+    void clear();
+
+private:
+    struct Zone {
+        const char* name;
+        QueueRole role;
+    };
+    struct FrameQueries {
+        VkQueryPool pool = VK_NULL_HANDLE;
+        std::atomic<uint32_t> zoneCount{0};
+        std::vector<Zone> zones;
+        std::chrono::steady_clock::time_point cpuStart;
+        bool recorded = false;
+    };
+    struct TraceEvent {
+        const char* name;
+        uint32_t thread;
+        double start;
+        double duration;
+    };
+    struct CounterEvent {
+        std::string name;
+        double time;
+        std::vector<std::pair<const char*, double>> series;
+    };
+
+    VkDevice _device;
+    double _timestampPeriod;
+    std::array<bool, queueRoleCount> _supported = {};
+    std::array<uint64_t, queueRoleCount> _timestampMasks = {};
+    uint32_t _maxZones;
+    std::vector<FrameQueries> _frames;
+    std::atomic<uint32_t> _frameIndex{0};
+    std::chrono::steady_clock::time_point _epoch;
+    std::atomic<bool> _capturing{false};
+
+    mutable std::mutex _mutex;
+    std::vector<TraceEvent> _events;
+    std::vector<CounterEvent> _counters;
+    std::vector<ZoneTiming> _lastFrame;
+
+    void collect(FrameQueries& frame);
+    double toMicroseconds(std::chrono::steady_clock::time_point time) const;
+};
+
+// Measures the enclosing scope on the GPU.
+class GpuZone {
+public:
+    GpuZone(Profiler& profiler, VkCommandBuffer cmd, QueueRole role, const char* name)
+        : _profiler(profiler), _cmd(cmd), _zone(profiler.beginZone(cmd, role, name)) {
+    }
+    ~GpuZone() {
+        _profiler.endZone(_cmd, _zone);
+    }
+
+    GpuZone(GpuZone const&) = delete;
+    void operator=(GpuZone const&) = delete;
+
+private:
+    Profiler& _profiler;
+    VkCommandBuffer _cmd;
+    uint32_t _zone;
+};
+
+// Measures the enclosing scope on the CPU.
+class CpuZone {
+public:
+    CpuZone(Profiler& profiler, const char* name)
+        : _profiler(profiler), _name(name), _start(std::chrono::steady_clock::now()) {
+    }
+    ~CpuZone() {
+        _profiler.addCpuZone(_name, _start, std::chrono::steady_clock::now());
+    }
+
+    CpuZone(CpuZone const&) = delete;
+    void operator=(CpuZone const&) = delete;
+
+private:
+    Profiler& _profiler;
+    const char* _name;
+    std::chrono::steady_clock::time_point _start;
+};
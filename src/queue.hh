@@ -0,0 +1,57 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstddef>
+#include <mutex>
+
+enum class QueueRole { Graphics, Compute, Transfer };
+constexpr size_t queueRoleCount = 3;
+
+// VkQueue plus the lock that serialises submissions to it. Several roles end up on the same
+// Queue when the device has no dedicated family for them.
+class Queue {
+public:
+    Queue(VkDevice device, uint32_t familyIndex, uint32_t index)
+        : _familyIndex(familyIndex), _index(index) {
+        vkGetDeviceQueue(device, familyIndex, index, &_handle);
+    }
+
+    Queue(Queue const&) = delete;
+    void operator=(Queue const&) = delete;
+
+    VkQueue getHandle() const {
+        return _handle;
+    }
+
+    uint32_t getFamilyIndex() const {
+        return _familyIndex;
+    }
+
+    uint32_t getIndex() const {
+        return _index;
+    }
+
+    VkResult submit(uint32_t submitCount, const VkSubmitInfo* submits,
+                    VkFence fence = VK_NULL_HANDLE) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return vkQueueSubmit(_handle, submitCount, submits, fence);
+    }
+
+    VkResult present(const VkPresentInfoKHR& presentInfo) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return vkQueuePresentKHR(_handle, &presentInfo);
+    }
+
+    VkResult waitIdle() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return vkQueueWaitIdle(_handle);
+    }
+
+private:
+    VkQueue _handle = VK_NULL_HANDLE;
+    uint32_t _familyIndex;
+    uint32_t _index;
+    std::mutex _mutex;
+};
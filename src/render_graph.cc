@@ -0,0 +1,489 @@
+#include "render_graph.hh"
+
+#include <numeric>
+#include <queue>
+
+struct AccessInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+    VkImageUsageFlags usage;
+    bool write;
+};
+
+static AccessInfo getAccessInfo(RenderGraph::Access access) {
+    const VkPipelineStageFlags shaderStages =
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    switch (access) {
+        case RenderGraph::Access::ColorAttachment:
+            return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                    true};
+        case RenderGraph::Access::DepthAttachment:
+            return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true};
+        case RenderGraph::Access::SampledRead:
+            return {shaderStages, VK_ACCESS_SHADER_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, false};
+        case RenderGraph::Access::StorageRead:
+            return {shaderStages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                    VK_IMAGE_USAGE_STORAGE_BIT, false};
+        case RenderGraph::Access::StorageWrite:
+            return {shaderStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, true};
+        case RenderGraph::Access::TransferRead:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false};
+        case RenderGraph::Access::TransferWrite:
+            return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true};
+    }
+    throw std::runtime_error("Unknown render graph access.");
+}
+
+// Uses of one image by a pass, merged into a single access : one barrier per image and pass.
+// Different layouts fall back to GENERAL, which every access here allows.
+static std::vector<std::pair<RenderGraph::ResourceHandle, AccessInfo>> mergeUses(
+    const std::vector<RenderGraph::Use>& uses) {
+    std::vector<std::pair<RenderGraph::ResourceHandle, AccessInfo>> merged;
+    for (auto& use : uses) {
+        auto info = getAccessInfo(use.access);
+        auto found = std::find_if(merged.begin(), merged.end(),
+                                  [&](auto& entry) { return entry.first == use.resource; });
+        if (found == merged.end()) {
+            merged.emplace_back(use.resource, info);
+            continue;
+        }
+        auto& access = found->second;
+        access.stages |= info.stages;
+        access.access |= info.access;
+        access.usage |= info.usage;
+        access.write = access.write || info.write;
+        if (access.layout != info.layout) access.layout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+    return merged;
+}
+
+static VkImageAspectFlags getAspect(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+static VkImageMemoryBarrier makeBarrier(VkImage image, VkFormat format, VkImageLayout oldLayout,
+                                        VkAccessFlags srcAccess, VkImageLayout newLayout,
+                                        VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {getAspect(format), 0, VK_REMAINING_MIP_LEVELS, 0,
+                                VK_REMAINING_ARRAY_LAYERS};
+    return barrier;
+}
+
+RenderGraph::RenderGraph(LogicalDevice& device) : _device(device) {
+}
+
+RenderGraph::~RenderGraph() {
+    releaseTransients();
+}
+
+RenderGraph::ResourceHandle RenderGraph::createImage(const std::string& name, VkExtent2D extent,
+                                                     VkFormat format) {
+    Resource resource;
+    resource.name = name;
+    resource.extent = extent;
+    resource.format = format;
+    _resources.push_back(resource);
+    return static_cast<ResourceHandle>(_resources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::importImage(
+    const std::string& name, VkImage image, VkImageView view, VkFormat format,
+    VkImageLayout initialLayout, VkImageLayout finalLayout,
+    VkPipelineStageFlags initialStages /* = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT */,
+    VkAccessFlags initialAccess /* = 0 */) {
+    Resource resource;
+    resource.name = name;
+    resource.format = format;
+    resource.imported = true;
+    resource.output = true;
+    resource.initialLayout = initialLayout;
+    resource.finalLayout = finalLayout;
+    resource.initialStages = initialStages;
+    resource.initialAccess = initialAccess;
+    resource.image = image;
+    resource.view = view;
+    _resources.push_back(resource);
+    return static_cast<ResourceHandle>(_resources.size() - 1);
+}
+
+void RenderGraph::setImportedImage(ResourceHandle resource, VkImage image, VkImageView view) {
+    if (!_resources[resource].imported) {
+        throw std::runtime_error(_resources[resource].name + " isn't an imported image.");
+    }
+    _resources[resource].image = image;
+    _resources[resource].view = view;
+}
+
+void RenderGraph::addPass(const std::string& name, const std::vector<Use>& uses,
+                          ExecuteFunction execute) {
+    for (auto& use : uses) {
+        if (use.resource >= _resources.size()) {
+            throw std::runtime_error("Pass " + name + " uses an unknown resource.");
+        }
+    }
+    _passes.push_back({name, uses, std::move(execute)});
+}
+
+void RenderGraph::markOutput(ResourceHandle resource) {
+    _resources[resource].output = true;
+}
+
+void RenderGraph::compile() {
+    releaseTransients();
+    _compiled.clear();
+    _statistics = Statistics();
+
+    auto order = cull(sort());
+    for (auto& resource : _resources) {
+        resource.firstUse = ~0u;
+        resource.lastUse = 0;
+        if (!resource.imported) resource.usage = 0;
+    }
+    for (uint32_t i = 0; i < order.size(); i++) {
+        CompiledPass compiled;
+        compiled.pass = order[i];
+        _compiled.push_back(compiled);
+        for (auto& use : _passes[order[i]].uses) {
+            auto& resource = _resources[use.resource];
+            resource.firstUse = std::min(resource.firstUse, i);
+            resource.lastUse = std::max(resource.lastUse, i);
+            resource.usage |= getAccessInfo(use.access).usage;
+        }
+    }
+    _statistics.passes = static_cast<uint32_t>(order.size());
+    _statistics.culledPasses = static_cast<uint32_t>(_passes.size() - order.size());
+
+    allocateTransients();
+    buildBarriers();
+    std::cerr << "Render graph compiled : " << _statistics.passes << " pass(es), "
+              << _statistics.culledPasses << " culled, " << _statistics.imageBarriers
+              << " image barrier(s) in " << _statistics.barrierBatches << " batch(es), "
+              << _statistics.allocatedBytes << " of " << _statistics.transientBytes
+              << " transient bytes allocated.\n";
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd) {
+    for (auto& compiled : _compiled) {
+        if (!compiled.barriers.empty()) {
+            patchImages(compiled.barriers, compiled.barrierResources);
+            vkCmdPipelineBarrier(cmd, compiled.srcStages, compiled.dstStages, 0, 0, nullptr, 0,
+                                 nullptr, static_cast<uint32_t>(compiled.barriers.size()),
+                                 compiled.barriers.data());
+        }
+        _passes[compiled.pass].execute(cmd);
+    }
+    if (!_finalBarriers.empty()) {
+        patchImages(_finalBarriers, _finalResources);
+        vkCmdPipelineBarrier(cmd, _finalSrcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                             nullptr, 0, nullptr, static_cast<uint32_t>(_finalBarriers.size()),
+                             _finalBarriers.data());
+    }
+}
+
+std::vector<uint32_t> RenderGraph::sort() const {
+    auto count = static_cast<uint32_t>(_passes.size());
+    std::vector<std::vector<std::pair<uint32_t, bool>>> users(_resources.size());
+    for (uint32_t pass = 0; pass < count; pass++) {
+        for (auto& [resource, info] : mergeUses(_passes[pass].uses)) {
+            users[resource].emplace_back(pass, info.write);
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> dependents(count);
+    std::vector<uint32_t> dependencies(count, 0);
+    auto depend = [&](uint32_t pass, uint32_t on) {
+        dependents[on].push_back(pass);
+        dependencies[pass]++;
+    };
+    for (ResourceHandle handle = 0; handle < _resources.size(); handle++) {
+        // Writes stay in declaration order, reads go after the write before them and before
+        // the write after them. Reads declared before any write : of the last write for a
+        // transient image, whose contents don't survive frames, of the initial contents for an
+        // imported one.
+        uint32_t firstWriter = ~0u, lastWriter = ~0u;
+        std::vector<uint32_t> readers, earlyReaders;
+        for (auto [pass, write] : users[handle]) {
+            if (!write) {
+                if (lastWriter == ~0u) {
+                    earlyReaders.push_back(pass);
+                } else {
+                    depend(pass, lastWriter);
+                    readers.push_back(pass);
+                }
+                continue;
+            }
+            if (lastWriter != ~0u) depend(pass, lastWriter);
+            for (auto reader : readers) depend(pass, reader);
+            readers.clear();
+            if (firstWriter == ~0u) firstWriter = pass;
+            lastWriter = pass;
+        }
+        if (lastWriter == ~0u) continue;
+        for (auto reader : earlyReaders) {
+            if (_resources[handle].imported) {
+                depend(firstWriter, reader);
+            } else {
+                depend(reader, lastWriter);
+            }
+        }
+    }
+
+    // Kahn's algorithm, the first declared of the ready passes going first.
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+    for (uint32_t pass = 0; pass < count; pass++) {
+        if (dependencies[pass] == 0) ready.push(pass);
+    }
+    std::vector<uint32_t> order;
+    while (!ready.empty()) {
+        uint32_t pass = ready.top();
+        ready.pop();
+        order.push_back(pass);
+        for (auto dependent : dependents[pass]) {
+            if (--dependencies[dependent] == 0) ready.push(dependent);
+        }
+    }
+    if (order.size() != count) {
+        throw std::runtime_error("Render graph passes depend on each other in a cycle.");
+    }
+    return order;
+}
+
+std::vector<uint32_t> RenderGraph::cull(const std::vector<uint32_t>& sorted) const {
+    std::vector<bool> needed(_resources.size(), false);
+    for (size_t i = 0; i < _resources.size(); i++) needed[i] = _resources[i].output;
+
+    // Walking backwards, a pass is kept when something after it needs one of its writes, and
+    // then needs everything it uses, written images included since it may load them.
+    std::vector<uint32_t> order;
+    for (size_t i = sorted.size(); i-- > 0;) {
+        uint32_t pass = sorted[i];
+        bool writes = false, keep = false;
+        for (auto& use : _passes[pass].uses) {
+            if (!getAccessInfo(use.access).write) continue;
+            writes = true;
+            keep = keep || needed[use.resource];
+        }
+        if (writes && !keep) continue;
+        for (auto& use : _passes[pass].uses) needed[use.resource] = true;
+        order.push_back(pass);
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+void RenderGraph::allocateTransients() {
+    VkDevice device = _device.getHandle();
+    auto allocator = _device.getAllocator().getHandle();
+
+    std::vector<ResourceHandle> transients;
+    std::vector<VkMemoryRequirements> requirements(_resources.size());
+    for (ResourceHandle handle = 0; handle < _resources.size(); handle++) {
+        auto& resource = _resources[handle];
+        if (resource.imported || resource.firstUse == ~0u) continue;
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.format;
+        imageInfo.extent = {resource.extent.width, resource.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create transient image " + resource.name + ".");
+        }
+        vkGetImageMemoryRequirements(device, resource.image, &requirements[handle]);
+        _statistics.transientBytes += requirements[handle].size;
+        transients.push_back(handle);
+    }
+
+    // Largest first, each image goes to the first slot whose images are all dead before it
+    // starts or born after it ends, and whose memory types it accepts. Outputs get a slot of
+    // their own : they are read through getImage() after the last pass.
+    std::sort(transients.begin(), transients.end(), [&](ResourceHandle a, ResourceHandle b) {
+        return requirements[a].size > requirements[b].size;
+    });
+    for (auto handle : transients) {
+        auto& resource = _resources[handle];
+        auto& required = requirements[handle];
+        MemorySlot* chosen = nullptr;
+        for (auto& slot : _slots) {
+            if (resource.output) break;
+            if (slot.output) continue;
+            if ((slot.requirements.memoryTypeBits & required.memoryTypeBits) == 0) continue;
+            bool overlaps = false;
+            for (auto other : slot.resources) {
+                auto& occupant = _resources[other];
+                overlaps = overlaps || !(occupant.lastUse < resource.firstUse ||
+                                         resource.lastUse < occupant.firstUse);
+            }
+            if (!overlaps) {
+                chosen = &slot;
+                break;
+            }
+        }
+        if (chosen == nullptr) {
+            _slots.emplace_back();
+            chosen = &_slots.back();
+            chosen->requirements = required;
+            chosen->output = resource.output;
+        }
+        chosen->requirements.size = std::max(chosen->requirements.size, required.size);
+        chosen->requirements.alignment =
+            std::max(chosen->requirements.alignment, required.alignment);
+        chosen->requirements.memoryTypeBits &= required.memoryTypeBits;
+        chosen->resources.push_back(handle);
+    }
+
+    for (auto& slot : _slots) {
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (vmaAllocateMemory(allocator, &slot.requirements, &allocInfo, &slot.allocation,
+                              nullptr) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate transient memory.");
+        }
+        _statistics.allocatedBytes += slot.requirements.size;
+
+        // Occupants in execution order : the first barrier of each one waits for the last use
+        // of the previous one, the first occupant for the last one of the previous frame.
+        std::sort(slot.resources.begin(), slot.resources.end(),
+                  [&](ResourceHandle a, ResourceHandle b) {
+                      return _resources[a].firstUse < _resources[b].firstUse;
+                  });
+        std::vector<State> lastStates;
+        for (auto handle : slot.resources) {
+            State last;
+            last.stages = 0;
+            for (auto& use : _passes[_compiled[_resources[handle].lastUse].pass].uses) {
+                if (use.resource != handle) continue;
+                auto info = getAccessInfo(use.access);
+                last.stages |= info.stages;
+                last.access |= info.write ? info.access : 0;
+            }
+            lastStates.push_back(last);
+        }
+        for (size_t i = 0; i < slot.resources.size(); i++) {
+            auto& resource = _resources[slot.resources[i]];
+            if (vmaBindImageMemory(allocator, slot.allocation, resource.image) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to bind transient image " + resource.name + ".");
+            }
+            resource.aliasedState = lastStates[(i + lastStates.size() - 1) % lastStates.size()];
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.format;
+            viewInfo.subresourceRange = {getAspect(resource.format), 0, 1, 0, 1};
+            if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create transient image view.");
+            }
+        }
+    }
+}
+
+void RenderGraph::buildBarriers() {
+    std::vector<State> states(_resources.size());
+    for (ResourceHandle handle = 0; handle < _resources.size(); handle++) {
+        auto& resource = _resources[handle];
+        states[handle] = resource.imported ? State{resource.initialLayout, resource.initialStages,
+                                                   resource.initialAccess, false}
+                                           : resource.aliasedState;
+        // Transient contents never survive a frame.
+        if (!resource.imported) states[handle].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    for (auto& compiled : _compiled) {
+        for (auto& [handle, info] : mergeUses(_passes[compiled.pass].uses)) {
+            auto& state = states[handle];
+            // Reads after reads in the same layout need nothing.
+            bool hazard = state.written || info.write || state.layout != info.layout;
+            if (!hazard) {
+                state.stages |= info.stages;
+                continue;
+            }
+            auto& resource = _resources[handle];
+            compiled.barriers.push_back(makeBarrier(resource.image, resource.format, state.layout,
+                                                    state.access, info.layout, info.access));
+            compiled.barrierResources.push_back(handle);
+            compiled.srcStages |= state.stages;
+            compiled.dstStages |= info.stages;
+            state = {info.layout, info.stages, info.write ? info.access : 0, info.write};
+        }
+        if (!compiled.barriers.empty()) {
+            _statistics.barrierBatches++;
+            _statistics.imageBarriers += static_cast<uint32_t>(compiled.barriers.size());
+        }
+    }
+
+    _finalBarriers.clear();
+    _finalResources.clear();
+    _finalSrcStages = 0;
+    for (ResourceHandle handle = 0; handle < _resources.size(); handle++) {
+        auto& resource = _resources[handle];
+        auto& state = states[handle];
+        if (!resource.imported || state.layout == resource.finalLayout) continue;
+        _finalBarriers.push_back(makeBarrier(resource.image, resource.format, state.layout,
+                                             state.access, resource.finalLayout, 0));
+        _finalResources.push_back(handle);
+        _finalSrcStages |= state.stages;
+    }
+    if (!_finalBarriers.empty()) {
+        _statistics.barrierBatches++;
+        _statistics.imageBarriers += static_cast<uint32_t>(_finalBarriers.size());
+    }
+}
+
+void RenderGraph::releaseTransients() {
+    VkDevice device = _device.getHandle();
+    for (auto& resource : _resources) {
+        if (resource.imported) continue;
+        if (resource.view != VK_NULL_HANDLE) vkDestroyImageView(device, resource.view, nullptr);
+        if (resource.image != VK_NULL_HANDLE) vkDestroyImage(device, resource.image, nullptr);
+        resource.view = VK_NULL_HANDLE;
+        resource.image = VK_NULL_HANDLE;
+        resource.aliasedState = State();
+    }
+    for (auto& slot : _slots) vmaFreeMemory(_device.getAllocator().getHandle(), slot.allocation);
+    _slots.clear();
+}
+
+void RenderGraph::patchImages(std::vector<VkImageMemoryBarrier>& barriers,
+                              const std::vector<ResourceHandle>& resources) const {
+    for (size_t i = 0; i < barriers.size(); i++) {
+        barriers[i].image = _resources[resources[i]].image;
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "application.hh"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Frame described as passes declaring how they use images. compile() orders the passes from
+// their uses, culls the passes no output depends on, derives every layout transition and
+// batches them into one barrier per pass boundary, and places transient images whose
+// lifetimes don't overlap in the same memory. A pass runs after the writes it reads, and
+// writes to an image keep their declaration order, which also breaks the remaining ties.
+//
+// Built once and compiled, then execute()d every frame. Imported images (e.g. swapchain
+// images) can be swapped between frames with setImportedImage().
+class RenderGraph {
+public:
+    using ResourceHandle = uint32_t;
+    using ExecuteFunction = std::function<void(VkCommandBuffer)>;
+
+    enum class Access {
+        ColorAttachment,
+        DepthAttachment,
+        SampledRead,
+        StorageRead,
+        StorageWrite,
+        TransferRead,
+        TransferWrite,
+    };
+    struct Use {
+        ResourceHandle resource;
+        Access access;
+    };
+    struct Statistics {
+        uint32_t passes = 0;
+        uint32_t culledPasses = 0;
+        uint32_t barrierBatches = 0;
+        uint32_t imageBarriers = 0;
+        VkDeviceSize transientBytes = 0;
+        VkDeviceSize allocatedBytes = 0;
+    };
+
+    explicit RenderGraph(LogicalDevice& device);
+    ~RenderGraph();
+
+    RenderGraph(RenderGraph const&) = delete;
+    void operator=(RenderGraph const&) = delete;
+
+    // Created by compile(), contents undefined at the start of every frame.
+    ResourceHandle createImage(const std::string& name, VkExtent2D extent, VkFormat format);
+
+    // Image owned elsewhere, in initialLayout when the frame starts and left in finalLayout.
+    // Imported images are the outputs of the graph. The first barrier waits on initialStages
+    // and initialAccess : for a swapchain image, the stage its acquire semaphore is waited at.
+    ResourceHandle importImage(
+        const std::string& name, VkImage image, VkImageView view, VkFormat format,
+        VkImageLayout initialLayout, VkImageLayout finalLayout,
+        VkPipelineStageFlags initialStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VkAccessFlags initialAccess = 0);
+    void setImportedImage(ResourceHandle resource, VkImage image, VkImageView view);
+
+    // A pass with no write is kept for its side effects.
+    void addPass(const std::string& name, const std::vector<Use>& uses, ExecuteFunction execute);
+
+    // Makes a transient image an output, so the passes writing it are never culled.
+    void markOutput(ResourceHandle resource);
+
+    void compile();
+    void execute(VkCommandBuffer cmd);
+
+    VkImage getImage(ResourceHandle resource) const {
+        return _resources[resource].image;
+    }
+
+    VkImageView getImageView(ResourceHandle resource) const {
+        return _resources[resource].view;
+    }
+
+    const Statistics& getStatistics() const {
+        return _statistics;
+    }
+
+private:
+    struct State {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkAccessFlags access = 0;
+        bool written = false;
+    };
+    struct Resource {
+        std::string name;
+        VkExtent2D extent = {0, 0};
+        VkFormat format;
+        VkImageUsageFlags usage = 0;
+        bool imported = false;
+        bool output = false;
+        VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags initialStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkAccessFlags initialAccess = 0;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        // Passes using the image, as indices into the compiled order.
+        uint32_t firstUse = ~0u;
+        uint32_t lastUse = 0;
+        // For aliased images : the last use of the previous occupant of the memory.
+        State aliasedState;
+    };
+    struct Pass {
+        std::string name;
+        std::vector<Use> uses;
+        ExecuteFunction execute;
+    };
+    struct CompiledPass {
+        uint32_t pass;
+        // Barriers before the pass and the resource of each, to patch in imported images.
+        std::vector<VkImageMemoryBarrier> barriers;
+        std::vector<ResourceHandle> barrierResources;
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+    };
+    struct MemorySlot {
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VkMemoryRequirements requirements;
+        std::vector<ResourceHandle> resources;
+        // Holds an output, shared with nothing.
+        bool output = false;
+    };
+
+    LogicalDevice& _device;
+    std::vector<Resource> _resources;
+    std::vector<Pass> _passes;
+    std::vector<CompiledPass> _compiled;
+    std::vector<MemorySlot> _slots;
+    std::vector<VkImageMemoryBarrier> _finalBarriers;
+    std::vector<ResourceHandle> _finalResources;
+    VkPipelineStageFlags _finalSrcStages = 0;
+    Statistics _statistics;
+
+    // Every pass, in execution order.
+    std::vector<uint32_t> sort() const;
+    std::vector<uint32_t> cull(const std::vector<uint32_t>& sorted) const;
+    void allocateTransients();
+    void buildBarriers();
+    void releaseTransients();
+    void patchImages(std::vector<VkImageMemoryBarrier>& barriers,
+                     const std::vector<ResourceHandle>& resources) const;
+};
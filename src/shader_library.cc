@@ -0,0 +1,213 @@
+#include "shader_library.hh"
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "pipeline_manager.hh"
+#include "utils.hh"
+
+static constexpr uint32_t spirvMagic = 0x07230203;
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope.
+struct MappedFile {
+    int fd = -1;
+    void* data = MAP_FAILED;
+    size_t size = 0;
+
+    explicit MappedFile(const std::string& path) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Failed to open shader file " + path + ".");
+        struct stat status;
+        if (fstat(fd, &status) == 0) size = static_cast<size_t>(status.st_size);
+        // A SPIR-V header alone is five words.
+        if (size >= 5 * sizeof(uint32_t) && size % sizeof(uint32_t) == 0) {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map shader file " + path + ".");
+        }
+    }
+
+    ~MappedFile() {
+        if (data != MAP_FAILED) munmap(data, size);
+        if (fd >= 0) close(fd);
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    void operator=(MappedFile const&) = delete;
+};
+
+static uint64_t hashWords(const uint32_t* words, size_t count) {
+    Hasher hasher;
+    hasher.addBytes(words, count * sizeof(uint32_t));
+    return hasher.value;
+}
+
+ShaderLibrary::ShaderLibrary(VkDevice device, bool hotReload /* = false */,
+                             const PipelineManager* pipelines /* = nullptr */)
+    : _device(device), _pipelines(pipelines) {
+    if (hotReload) {
+        _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify < 0) std::cerr << "inotify unavailable, shader hot reload disabled.\n";
+    }
+    std::cerr << "Shader library successfully created (hot reload "
+              << (isHotReloadEnabled() ? "on" : "off") << ").\n";
+}
+
+ShaderLibrary::~ShaderLibrary() {
+    for (auto& module : _modules) vkDestroyShaderModule(_device, module.second.handle, nullptr);
+    for (auto& module : _retired) vkDestroyShaderModule(_device, module.handle, nullptr);
+    if (_inotify >= 0) close(_inotify);
+    std::cerr << "Destroyed shader library.\n";
+}
+
+const Shader& ShaderLibrary::load(const std::string& path) {
+    auto found = _shaders.find(path);
+    if (found != _shaders.end()) return *found->second;
+
+    auto shader = std::make_unique<Shader>();
+    shader->_path = path;
+    shader->_module = acquireModule(path, shader->_hash, shader->_reflection);
+    auto& result = *shader;
+    _shaders.emplace(path, std::move(shader));
+    if (isHotReloadEnabled()) watch(result);
+    return result;
+}
+
+void ShaderLibrary::onReload(const Shader& shader, std::function<void(const Shader&)> listener) {
+    _shaders.at(shader._path)->_listeners.push_back(std::move(listener));
+}
+
+uint32_t ShaderLibrary::poll(uint64_t frame, uint64_t completedFrame) {
+    bool compiling = _pipelines != nullptr && !_pipelines->isIdle();
+    auto done = std::partition(_retired.begin(), _retired.end(), [&](const RetiredModule& module) {
+        return compiling || module.frame > completedFrame;
+    });
+    for (auto it = done; it != _retired.end(); ++it) {
+        vkDestroyShaderModule(_device, it->handle, nullptr);
+    }
+    _retired.erase(done, _retired.end());
+    _frame = frame;
+    if (!isHotReloadEnabled()) return 0;
+
+    // An editor saving a file usually raises several events, reload each file once.
+    std::unordered_set<Shader*> changed;
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(_inotify, buffer, sizeof(buffer));
+        if (length <= 0) {
+            if (length < 0 && errno != EAGAIN) std::cerr << "Failed to read inotify events.\n";
+            break;
+        }
+        for (ssize_t offset = 0; offset < length;) {
+            auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            auto watch = _watches.find(event->wd);
+            if (watch == _watches.end() || event->len == 0) continue;
+            auto file = watch->second.files.find(event->name);
+            if (file != watch->second.files.end()) changed.insert(file->second);
+        }
+    }
+
+    uint32_t reloaded = 0;
+    for (auto shader : changed) {
+        if (!reload(*shader)) continue;
+        reloaded++;
+        for (auto& listener : shader->_listeners) listener(*shader);
+    }
+    return reloaded;
+}
+
+VkShaderModule ShaderLibrary::acquireModule(const std::string& path, uint64_t& hash,
+                                            ShaderReflection& reflection) {
+    MappedFile file(path);
+    auto words = static_cast<const uint32_t*>(file.data);
+    size_t wordCount = file.size / sizeof(uint32_t);
+    if (words[0] != spirvMagic) throw std::runtime_error(path + " is not a SPIR-V file.");
+    hash = hashWords(words, wordCount);
+    reflection = reflectSpirv(words, wordCount);
+
+    // Hashes can collide : only the same words share a module.
+    auto [first, last] = _modules.equal_range(hash);
+    for (auto found = first; found != last; ++found) {
+        auto& module = found->second;
+        if (module.words.size() == wordCount &&
+            std::memcmp(module.words.data(), words, file.size) == 0) {
+            module.users++;
+            return module.handle;
+        }
+    }
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = file.size;
+    createInfo.pCode = words;
+    VkShaderModule module;
+    if (vkCreateShaderModule(_device, &createInfo, nullptr, &module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shader module for " + path + ".");
+    }
+    _modules.emplace(hash, Module{module, 1, std::vector<uint32_t>(words, words + wordCount)});
+    return module;
+}
+
+void ShaderLibrary::releaseModule(uint64_t hash, VkShaderModule module) {
+    auto [first, last] = _modules.equal_range(hash);
+    auto found = std::find_if(first, last, [&](const auto& entry) {
+        return entry.second.handle == module;
+    });
+    if (--found->second.users > 0) return;
+    _retired.push_back({module, _frame});
+    _modules.erase(found);
+}
+
+void ShaderLibrary::watch(Shader& shader) {
+    // Editors often save by renaming a new file over the old one, which a watch on the file
+    // itself would miss : watch its directory instead.
+    size_t slash = shader._path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : shader._path.substr(0, slash);
+    std::string name = slash == std::string::npos ? shader._path : shader._path.substr(slash + 1);
+
+    int descriptor = inotify_add_watch(_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (descriptor < 0) {
+        std::cerr << "Failed to watch " << directory << ", no hot reload for " << shader._path
+                  << ".\n";
+        return;
+    }
+    // Watching a directory twice returns the same descriptor.
+    auto& watch = _watches[descriptor];
+    watch.directory = directory;
+    watch.files[name] = &shader;
+}
+
+bool ShaderLibrary::reload(Shader& shader) {
+    uint64_t hash;
+    ShaderReflection reflection;
+    VkShaderModule module;
+    try {
+        module = acquireModule(shader._path, hash, reflection);
+    } catch (const std::exception& e) {
+        std::cerr << "Shader reload failed, keeping the previous version: " << e.what() << "\n";
+        return false;
+    }
+    if (module == shader._module) {
+        releaseModule(hash, module);
+        return false;
+    }
+    releaseModule(shader._hash, shader._module);
+    shader._module = module;
+    shader._hash = hash;
+    shader._reflection = std::move(reflection);
+    std::cerr << "Reloaded shader " << shader._path << ".\n";
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "spirv_reflection.hh"
+
+class PipelineManager;
+
+// SPIR-V file loaded by the library. The module changes when the file is hot reloaded, so
+// users fetch it with getModule() when they (re)build a pipeline rather than keeping it.
+class Shader {
+public:
+    const std::string& getPath() const {
+        return _path;
+    }
+
+    VkShaderModule getModule() const {
+        return _module;
+    }
+
+    // FNV-1a of the SPIR-V words. Identical files share a module, matching hashes alone don't.
+    uint64_t getHash() const {
+        return _hash;
+    }
+
+    // Of the current content, updated along with the module.
+    const ShaderReflection& getReflection() const {
+        return _reflection;
+    }
+
+private:
+    friend class ShaderLibrary;
+
+    std::string _path;
+    VkShaderModule _module = VK_NULL_HANDLE;
+    uint64_t _hash = 0;
+    ShaderReflection _reflection;
+    std::vector<std::function<void(const Shader&)>> _listeners;
+};
+
+// Loads SPIR-V files through mmap and deduplicates VkShaderModules by content hash. With hot
+// reload on, the directories of loaded files are watched with inotify and poll() reloads the
+// files that changed, then calls their listeners so only the pipelines using them get rebuilt.
+//
+// Not thread safe : load() and poll() run on one thread, typically once per frame. Modules
+// replaced by a reload are kept until the frames recorded before the reload completed and,
+// when the library knows the PipelineManager, until it has no compile in flight : a pipeline
+// requested before the reload may still be built from them.
+class ShaderLibrary {
+public:
+    // Without `pipelines`, retired modules only wait for frames : pipelines must then be built
+    // from modules of the current frame, or the caller drains its compiles before poll().
+    ShaderLibrary(VkDevice device, bool hotReload = false,
+                  const PipelineManager* pipelines = nullptr);
+    ~ShaderLibrary();
+
+    ShaderLibrary(ShaderLibrary const&) = delete;
+    void operator=(ShaderLibrary const&) = delete;
+
+    // Loading a path twice returns the same shader. The reference lives as long as the library.
+    const Shader& load(const std::string& path);
+
+    // `listener` runs from poll() each time the shader's file is reloaded with new content.
+    void onReload(const Shader& shader, std::function<void(const Shader&)> listener);
+
+    // Non-blocking, once per frame before recording, with the frame number (from 1) and the last
+    // completed one. Returns the number of shaders reloaded with new content; a file failing to
+    // load (half written, invalid) keeps its previous module and is retried on its next change.
+    uint32_t poll(uint64_t frame, uint64_t completedFrame);
+
+    bool isHotReloadEnabled() const {
+        return _inotify >= 0;
+    }
+
+private:
+    struct Module {
+        VkShaderModule handle;
+        uint32_t users;
+        std::vector<uint32_t> words;
+    };
+    struct RetiredModule {
+        VkShaderModule handle;
+        // Last frame that may have used it.
+        uint64_t frame;
+    };
+    struct Watch {
+        std::string directory;
+        // File name within the directory to shader.
+        std::unordered_map<std::string, Shader*> files;
+    };
+
+    VkDevice _device;
+    const PipelineManager* _pipelines;
+    int _inotify = -1;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> _shaders;
+    std::unordered_multimap<uint64_t, Module> _modules;
+    std::vector<RetiredModule> _retired;
+    uint64_t _frame = 0;
+    // By inotify watch descriptor.
+    std::unordered_map<int, Watch> _watches;
+
+    // Maps the file and returns the module for its content, creating it when it's new.
+    VkShaderModule acquireModule(const std::string& path, uint64_t& hash,
+                                 ShaderReflection& reflection);
+    void releaseModule(uint64_t hash, VkShaderModule module);
+    void watch(Shader& shader);
+    bool reload(Shader& shader);
+};
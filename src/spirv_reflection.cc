@@ -0,0 +1,522 @@
+#include "spirv_reflection.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+// The subset of the SPIR-V specification's enumerants reflection needs.
+namespace spv {
+static constexpr uint32_t magic = 0x07230203;
+static constexpr uint32_t version14 = 0x00010400;
+
+enum Op : uint32_t {
+    OpEntryPoint = 15,
+    OpExecutionMode = 16,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpSpecConstantTrue = 48,
+    OpSpecConstantFalse = 49,
+    OpSpecConstant = 50,
+    OpFunction = 54,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpTypeAccelerationStructureKHR = 5341,
+};
+
+enum Decoration : uint32_t {
+    SpecId = 1,
+    Block = 2,
+    BufferBlock = 3,
+    RowMajor = 4,
+    ArrayStride = 6,
+    MatrixStride = 7,
+    BuiltIn = 11,
+    Location = 30,
+    Binding = 33,
+    DescriptorSet = 34,
+    Offset = 35,
+};
+
+enum StorageClass : uint32_t {
+    UniformConstant = 0,
+    Input = 1,
+    Uniform = 2,
+    PushConstant = 9,
+    StorageBuffer = 12,
+};
+
+static constexpr uint32_t executionModeLocalSize = 17;
+static constexpr uint32_t dimBuffer = 5;
+static constexpr uint32_t dimSubpassData = 6;
+}  // namespace spv
+
+namespace {
+
+struct Type {
+    uint32_t opcode;
+    // Operands following the result id.
+    std::vector<uint32_t> operands;
+};
+
+struct Decorations {
+    uint32_t set = ~0u;
+    uint32_t binding = ~0u;
+    uint32_t location = ~0u;
+    uint32_t specId = ~0u;
+    uint32_t arrayStride = 0;
+    bool block = false;
+    bool bufferBlock = false;
+    bool builtIn = false;
+    std::unordered_map<uint32_t, uint32_t> memberOffsets;
+    std::unordered_map<uint32_t, uint32_t> memberMatrixStrides;
+    std::unordered_set<uint32_t> memberRowMajor;
+};
+
+struct Constant {
+    uint32_t type;
+    uint64_t value;
+    bool specialization;
+};
+
+struct Variable {
+    uint32_t id;
+    uint32_t type;
+    uint32_t storageClass;
+};
+
+class Module {
+public:
+    Module(const uint32_t* words, size_t wordCount);
+
+    ShaderReflection reflect() const;
+
+private:
+    uint32_t _version = 0;
+    bool _hasEntryPoint = false;
+    uint32_t _executionModel = 0;
+    uint32_t _entryPointId = 0;
+    std::string _entryPointName;
+    std::unordered_set<uint32_t> _interface;
+    uint32_t _localSize[3] = {0, 0, 0};
+    std::unordered_map<uint32_t, Type> _types;
+    std::unordered_map<uint32_t, Decorations> _decorations;
+    std::unordered_map<uint32_t, Constant> _constants;
+    std::vector<Variable> _variables;
+
+    const Type& type(uint32_t id) const;
+    const Decorations* decorations(uint32_t id) const;
+    uint32_t arrayLength(const Type& array) const;
+    uint32_t sizeOf(uint32_t typeId) const;
+    uint32_t memberSize(uint32_t structId, uint32_t member) const;
+    bool descriptorType(uint32_t storageClass, uint32_t typeId, VkDescriptorType& result) const;
+    VkFormat vertexFormat(uint32_t typeId) const;
+};
+
+std::string readString(const uint32_t* operands, uint32_t count, uint32_t& consumedWords) {
+    auto bytes = reinterpret_cast<const char*>(operands);
+    size_t length = 0;
+    while (length < count * sizeof(uint32_t) && bytes[length] != '\0') length++;
+    if (length == count * sizeof(uint32_t)) throw std::runtime_error("Unterminated SPIR-V string.");
+    consumedWords = static_cast<uint32_t>(length / sizeof(uint32_t) + 1);
+    return std::string(bytes, length);
+}
+
+Module::Module(const uint32_t* words, size_t wordCount) {
+    if (wordCount < 5 || words[0] != spv::magic) throw std::runtime_error("Invalid SPIR-V header.");
+    _version = words[1];
+
+    for (size_t i = 5; i < wordCount;) {
+        uint32_t opcode = words[i] & 0xffff;
+        uint32_t length = words[i] >> 16;
+        if (length == 0 || i + length > wordCount) {
+            throw std::runtime_error("Truncated SPIR-V instruction.");
+        }
+        const uint32_t* op = words + i + 1;
+        uint32_t count = length - 1;
+        i += length;
+
+        switch (opcode) {
+            case spv::OpEntryPoint: {
+                if (_hasEntryPoint || count < 3) break;
+                _hasEntryPoint = true;
+                _executionModel = op[0];
+                _entryPointId = op[1];
+                uint32_t consumed;
+                _entryPointName = readString(op + 2, count - 2, consumed);
+                for (uint32_t k = 2 + consumed; k < count; k++) _interface.insert(op[k]);
+                break;
+            }
+            case spv::OpExecutionMode:
+                if (count >= 5 && op[0] == _entryPointId &&
+                    op[1] == spv::executionModeLocalSize) {
+                    std::copy(op + 2, op + 5, _localSize);
+                }
+                break;
+            case spv::OpDecorate: {
+                if (count < 2) break;
+                auto& target = _decorations[op[0]];
+                uint32_t literal = count >= 3 ? op[2] : 0;
+                switch (op[1]) {
+                    case spv::SpecId: target.specId = literal; break;
+                    case spv::Block: target.block = true; break;
+                    case spv::BufferBlock: target.bufferBlock = true; break;
+                    case spv::ArrayStride: target.arrayStride = literal; break;
+                    case spv::BuiltIn: target.builtIn = true; break;
+                    case spv::Location: target.location = literal; break;
+                    case spv::Binding: target.binding = literal; break;
+                    case spv::DescriptorSet: target.set = literal; break;
+                    default: break;
+                }
+                break;
+            }
+            case spv::OpMemberDecorate: {
+                if (count < 3) break;
+                auto& target = _decorations[op[0]];
+                uint32_t literal = count >= 4 ? op[3] : 0;
+                switch (op[2]) {
+                    case spv::Offset: target.memberOffsets[op[1]] = literal; break;
+                    case spv::MatrixStride: target.memberMatrixStrides[op[1]] = literal; break;
+                    case spv::RowMajor: target.memberRowMajor.insert(op[1]); break;
+                    default: break;
+                }
+                break;
+            }
+            case spv::OpTypeBool:
+            case spv::OpTypeInt:
+            case spv::OpTypeFloat:
+            case spv::OpTypeVector:
+            case spv::OpTypeMatrix:
+            case spv::OpTypeImage:
+            case spv::OpTypeSampler:
+            case spv::OpTypeSampledImage:
+            case spv::OpTypeArray:
+            case spv::OpTypeRuntimeArray:
+            case spv::OpTypeStruct:
+            case spv::OpTypePointer:
+            case spv::OpTypeAccelerationStructureKHR:
+                if (count < 1) break;
+                _types[op[0]] = Type{opcode, std::vector<uint32_t>(op + 1, op + count)};
+                break;
+            case spv::OpConstant:
+            case spv::OpSpecConstant: {
+                if (count < 3) break;
+                uint64_t value = op[2];
+                if (count >= 4) value |= static_cast<uint64_t>(op[3]) << 32;
+                _constants[op[1]] = Constant{op[0], value, opcode == spv::OpSpecConstant};
+                break;
+            }
+            case spv::OpSpecConstantTrue:
+            case spv::OpSpecConstantFalse:
+                if (count < 2) break;
+                _constants[op[1]] = Constant{op[0], opcode == spv::OpSpecConstantTrue, true};
+                break;
+            case spv::OpVariable:
+                if (count < 3) break;
+                _variables.push_back(Variable{op[1], op[0], op[2]});
+                break;
+            case spv::OpFunction:
+                // Everything reflection needs is declared before the first function.
+                i = wordCount;
+                break;
+            default:
+                break;
+        }
+    }
+    if (!_hasEntryPoint) throw std::runtime_error("SPIR-V module without entry point.");
+}
+
+const Type& Module::type(uint32_t id) const {
+    auto found = _types.find(id);
+    if (found == _types.end()) throw std::runtime_error("Undefined SPIR-V type.");
+    return found->second;
+}
+
+const Decorations* Module::decorations(uint32_t id) const {
+    auto found = _decorations.find(id);
+    return found == _decorations.end() ? nullptr : &found->second;
+}
+
+uint32_t Module::arrayLength(const Type& array) const {
+    // Arrays sized by a specialization constant get their default size.
+    auto found = _constants.find(array.operands.at(1));
+    if (found == _constants.end()) throw std::runtime_error("Unknown SPIR-V array length.");
+    return static_cast<uint32_t>(found->second.value);
+}
+
+uint32_t Module::sizeOf(uint32_t typeId) const {
+    const Type& t = type(typeId);
+    switch (t.opcode) {
+        case spv::OpTypeBool:
+            return 4;
+        case spv::OpTypeInt:
+        case spv::OpTypeFloat:
+            return t.operands.at(0) / 8;
+        case spv::OpTypeVector:
+        case spv::OpTypeMatrix:
+            return t.operands.at(1) * sizeOf(t.operands.at(0));
+        case spv::OpTypeArray: {
+            auto decorated = decorations(typeId);
+            uint32_t stride = decorated && decorated->arrayStride ? decorated->arrayStride
+                                                                  : sizeOf(t.operands.at(0));
+            return arrayLength(t) * stride;
+        }
+        case spv::OpTypeStruct: {
+            auto decorated = decorations(typeId);
+            uint32_t size = 0;
+            for (uint32_t member = 0; member < t.operands.size(); member++) {
+                uint32_t offset = size;
+                if (decorated && decorated->memberOffsets.count(member)) {
+                    offset = decorated->memberOffsets.at(member);
+                }
+                size = std::max(size, offset + memberSize(typeId, member));
+            }
+            return size;
+        }
+        default:
+            return 0;
+    }
+}
+
+uint32_t Module::memberSize(uint32_t structId, uint32_t member) const {
+    uint32_t memberType = type(structId).operands.at(member);
+    const Type& t = type(memberType);
+    auto decorated = decorations(structId);
+    if (t.opcode == spv::OpTypeMatrix && decorated &&
+        decorated->memberMatrixStrides.count(member)) {
+        uint32_t stride = decorated->memberMatrixStrides.at(member);
+        // Row major matrices store one stride per row, rows being the column vector's size.
+        uint32_t vectors = decorated->memberRowMajor.count(member)
+                               ? type(t.operands.at(0)).operands.at(1)
+                               : t.operands.at(1);
+        return vectors * stride;
+    }
+    return sizeOf(memberType);
+}
+
+bool Module::descriptorType(uint32_t storageClass, uint32_t typeId,
+                            VkDescriptorType& result) const {
+    const Type& t = type(typeId);
+    if (storageClass == spv::StorageBuffer) {
+        result = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        return true;
+    }
+    if (storageClass == spv::Uniform) {
+        auto decorated = decorations(typeId);
+        if (!decorated) return false;
+        if (decorated->bufferBlock) {
+            result = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            return true;
+        }
+        result = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return decorated->block;
+    }
+    switch (t.opcode) {
+        case spv::OpTypeSampler:
+            result = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        case spv::OpTypeSampledImage:
+            result = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        case spv::OpTypeAccelerationStructureKHR:
+            result = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+            return true;
+        case spv::OpTypeImage: {
+            uint32_t dim = t.operands.at(1);
+            // 1 : used with a sampler, 2 : storage image.
+            bool storage = t.operands.at(5) == 2;
+            if (dim == spv::dimSubpassData) {
+                result = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            } else if (dim == spv::dimBuffer) {
+                result = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+                                 : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            } else {
+                result = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                                 : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+VkFormat Module::vertexFormat(uint32_t typeId) const {
+    const Type* t = &type(typeId);
+    uint32_t components = 1;
+    if (t->opcode == spv::OpTypeVector) {
+        components = t->operands.at(1);
+        t = &type(t->operands.at(0));
+    }
+    if (t->opcode != spv::OpTypeInt && t->opcode != spv::OpTypeFloat) return VK_FORMAT_UNDEFINED;
+    if (t->operands.at(0) != 32 || components < 1 || components > 4) return VK_FORMAT_UNDEFINED;
+
+    static const VkFormat floats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+                                      VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat sints[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT,
+                                     VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat uints[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT,
+                                     VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+    if (t->opcode == spv::OpTypeFloat) return floats[components - 1];
+    return t->operands.at(1) ? sints[components - 1] : uints[components - 1];
+}
+
+ShaderReflection Module::reflect() const {
+    ShaderReflection reflection;
+    static const VkShaderStageFlagBits stages[] = {
+        VK_SHADER_STAGE_VERTEX_BIT,
+        VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+        VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+        VK_SHADER_STAGE_GEOMETRY_BIT,
+        VK_SHADER_STAGE_FRAGMENT_BIT,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+    if (_executionModel >= sizeof(stages) / sizeof(stages[0])) {
+        throw std::runtime_error("Unsupported SPIR-V execution model.");
+    }
+    reflection.stage = stages[_executionModel];
+    reflection.entryPoint = _entryPointName;
+    if (reflection.stage == VK_SHADER_STAGE_COMPUTE_BIT) {
+        std::copy(_localSize, _localSize + 3, reflection.localSize);
+    }
+
+    bool filterByInterface = _version >= spv::version14;
+    uint32_t pushConstantEnd = 0;
+    for (auto& variable : _variables) {
+        if (filterByInterface && !_interface.count(variable.id)) continue;
+        const Type& pointer = type(variable.type);
+        uint32_t pointee = pointer.operands.at(1);
+        auto decorated = decorations(variable.id);
+
+        switch (variable.storageClass) {
+            case spv::UniformConstant:
+            case spv::Uniform:
+            case spv::StorageBuffer: {
+                if (!decorated || decorated->set == ~0u || decorated->binding == ~0u) break;
+                uint32_t count = 1;
+                const Type* t = &type(pointee);
+                while (t->opcode == spv::OpTypeArray || t->opcode == spv::OpTypeRuntimeArray) {
+                    count = t->opcode == spv::OpTypeArray ? count * arrayLength(*t) : 0;
+                    pointee = t->operands.at(0);
+                    t = &type(pointee);
+                }
+                VkDescriptorType descriptor;
+                if (!descriptorType(variable.storageClass, pointee, descriptor)) break;
+                reflection.bindings.push_back({decorated->set, decorated->binding, descriptor,
+                                               count});
+                break;
+            }
+            case spv::PushConstant: {
+                const Type& block = type(pointee);
+                auto blockDecorations = decorations(pointee);
+                uint32_t offset = ~0u;
+                for (uint32_t member = 0; member < block.operands.size(); member++) {
+                    uint32_t memberOffset = 0;
+                    if (blockDecorations && blockDecorations->memberOffsets.count(member)) {
+                        memberOffset = blockDecorations->memberOffsets.at(member);
+                    }
+                    offset = std::min(offset, memberOffset);
+                }
+                if (offset == ~0u) break;
+                pushConstantEnd = std::max(pushConstantEnd, sizeOf(pointee));
+                reflection.pushConstantOffset = offset;
+                break;
+            }
+            case spv::Input: {
+                if (reflection.stage != VK_SHADER_STAGE_VERTEX_BIT) break;
+                if (!decorated || decorated->builtIn || decorated->location == ~0u) break;
+                const Type& t = type(pointee);
+                // Matrices take one location per column.
+                uint32_t columns = t.opcode == spv::OpTypeMatrix ? t.operands.at(1) : 1;
+                uint32_t column = t.opcode == spv::OpTypeMatrix ? t.operands.at(0) : pointee;
+                for (uint32_t c = 0; c < columns; c++) {
+                    reflection.vertexInputs.push_back(
+                        {decorated->location + c, vertexFormat(column)});
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (pushConstantEnd > 0) {
+        reflection.pushConstantSize = pushConstantEnd - reflection.pushConstantOffset;
+    }
+
+    for (auto& entry : _constants) {
+        if (!entry.second.specialization) continue;
+        auto decorated = decorations(entry.first);
+        if (!decorated || decorated->specId == ~0u) continue;
+        reflection.specializationConstants.push_back(
+            {decorated->specId, sizeOf(entry.second.type), entry.second.value});
+    }
+
+    std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+              [](const ShaderReflection::Binding& a, const ShaderReflection::Binding& b) {
+                  return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+              });
+    std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(),
+              [](const ShaderReflection::VertexInput& a, const ShaderReflection::VertexInput& b) {
+                  return a.location < b.location;
+              });
+    std::sort(reflection.specializationConstants.begin(),
+              reflection.specializationConstants.end(),
+              [](const ShaderReflection::SpecializationConstant& a,
+                 const ShaderReflection::SpecializationConstant& b) { return a.id < b.id; });
+    return reflection;
+}
+
+uint32_t formatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32_SINT:
+        case VK_FORMAT_R32_UINT:
+            return 4;
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R32G32_SINT:
+        case VK_FORMAT_R32G32_UINT:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+        case VK_FORMAT_R32G32B32_SINT:
+        case VK_FORMAT_R32G32B32_UINT:
+            return 12;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+        case VK_FORMAT_R32G32B32A32_SINT:
+        case VK_FORMAT_R32G32B32A32_UINT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+}  // namespace
+
+std::vector<VkVertexInputAttributeDescription> ShaderReflection::getPackedVertexAttributes(
+    uint32_t binding, uint32_t& stride) const {
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    stride = 0;
+    for (auto& input : vertexInputs) {
+        if (input.format == VK_FORMAT_UNDEFINED) {
+            throw std::runtime_error("Vertex input without a vertex buffer format.");
+        }
+        attributes.push_back({input.location, binding, input.format, stride});
+        stride += formatSize(input.format);
+    }
+    return attributes;
+}
+
+ShaderReflection reflectSpirv(const uint32_t* words, size_t wordCount) {
+    return Module(words, wordCount).reflect();
+}
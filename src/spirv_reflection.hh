@@ -0,0 +1,51 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+
+// Resources and interface of a SPIR-V entry point, read straight from the binary. Only the
+// first entry point of a module is reflected. From SPIR-V 1.4 on, entry points list every
+// global they use, so resources declared but unused by the entry point are left out.
+struct ShaderReflection {
+    struct Binding {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType type;
+        // Product of the array dimensions, 0 for a runtime array.
+        uint32_t count;
+    };
+    struct VertexInput {
+        uint32_t location;
+        // VK_FORMAT_UNDEFINED for types a vertex buffer can't feed as is (64-bit, bool).
+        VkFormat format;
+    };
+    struct SpecializationConstant {
+        uint32_t id;
+        // In bytes, as laid out in VkSpecializationInfo data. Booleans take 4 (VkBool32).
+        uint32_t size;
+        uint64_t defaultValue;
+    };
+
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+    std::string entryPoint;
+    std::vector<Binding> bindings;
+    // [pushConstantOffset, pushConstantOffset + pushConstantSize) is what the stage reads.
+    uint32_t pushConstantOffset = 0;
+    uint32_t pushConstantSize = 0;
+    // Vertex stage only, sorted by location.
+    std::vector<VertexInput> vertexInputs;
+    std::vector<SpecializationConstant> specializationConstants;
+    // Compute stage only, when not given by specialization constants.
+    uint32_t localSize[3] = {0, 0, 0};
+
+    // Attributes of the vertex inputs packed back to back in one vertex buffer, in location
+    // order. `stride` receives the size of a vertex.
+    std::vector<VkVertexInputAttributeDescription> getPackedVertexAttributes(
+        uint32_t binding, uint32_t& stride) const;
+};
+
+// Throws on malformed SPIR-V. Unknown instructions are skipped.
+ShaderReflection reflectSpirv(const uint32_t* words, size_t wordCount);
@@ -0,0 +1,315 @@
+#include "staging_uploader.hh"
+
+#include <numeric>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+StagingUploader::StagingUploader(LogicalDevice& device,
+                                 VkDeviceSize capacity /* = 64 * 1024 * 1024 */)
+    : _device(device),
+      _queue(device.getQueue(QueueRole::Transfer)),
+      _ring(device.getAllocator(), capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VMA_MEMORY_USAGE_AUTO,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                VMA_ALLOCATION_CREATE_MAPPED_BIT),
+      _ringData(static_cast<uint8_t*>(_ring.getMappedData())),
+      _capacity(capacity),
+      _alignment(std::max<VkDeviceSize>(
+          16, device.getPhysicalDevice().getProperties().limits.optimalBufferCopyOffsetAlignment)) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags =
+        VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = _queue.getFamilyIndex();
+    if (vkCreateCommandPool(_device.getHandle(), &poolInfo, nullptr, &_commandPool) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to create staging command pool.");
+    }
+}
+
+StagingUploader::~StagingUploader() {
+    waitIdle();
+    for (auto& batch : _freeBatches) vkDestroyFence(_device.getHandle(), batch.fence, nullptr);
+    vkDestroyCommandPool(_device.getHandle(), _commandPool, nullptr);
+}
+
+void StagingUploader::upload(const void* data, VkDeviceSize size, VkBuffer dst,
+                             VkDeviceSize dstOffset /* = 0 */) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        VkDeviceSize chunk = std::min(size, _capacity);
+        VkDeviceSize offset = allocate(chunk, _alignment);
+        std::memcpy(_ringData + offset, bytes, chunk);
+        _bufferCopies.push_back({dst, {offset, dstOffset, chunk}});
+        _pendingBytes += chunk;
+        bytes += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+    }
+}
+
+void StagingUploader::upload(const void* data, VkDeviceSize size, VkImage dst,
+                             const VkBufferImageCopy& region,
+                             VkImageLayout finalLayout /* = SHADER_READ_ONLY_OPTIMAL */,
+                             VkDeviceSize texelSize /* = 4 */) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (size > _capacity) {
+        throw std::runtime_error("Image upload larger than the staging ring.");
+    }
+    VkDeviceSize offset = allocate(size, std::lcm(_alignment, texelSize));
+    std::memcpy(_ringData + offset, data, size);
+    ImageCopy copy{dst, region, size, finalLayout};
+    copy.region.bufferOffset = offset;
+    _imageCopies.push_back(copy);
+    _pendingBytes += size;
+}
+
+void StagingUploader::upload(const void* data, VkDeviceSize size, const Image& dst,
+                             VkImageLayout finalLayout /* = SHADER_READ_ONLY_OPTIMAL */,
+                             VkDeviceSize texelSize /* = 4 */) {
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = dst.getExtent();
+    upload(data, size, dst.getHandle(), region, finalLayout, texelSize);
+}
+
+uint64_t StagingUploader::flush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return submit();
+}
+
+bool StagingUploader::isComplete(uint64_t batch) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    retire(false);
+    return _completedBatch >= batch;
+}
+
+void StagingUploader::wait(uint64_t batch) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    while (_completedBatch < batch && !_inFlight.empty()) retire(true);
+}
+
+void StagingUploader::waitIdle() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    submit();
+    while (!_inFlight.empty()) retire(true);
+}
+
+StagingUploader::Statistics StagingUploader::getStatistics() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Statistics statistics = _statistics;
+    double seconds = std::chrono::duration<double>(_lastRetire - _firstSubmit).count();
+    if (seconds > 0.0) statistics.megabytesPerSecond = statistics.bytesUploaded / seconds / 1e6;
+    return statistics;
+}
+
+std::vector<uint32_t> StagingUploader::getQueueFamilies() const {
+    uint32_t graphicsFamily = _device.getQueue(QueueRole::Graphics).getFamilyIndex();
+    if (graphicsFamily == _queue.getFamilyIndex()) return {graphicsFamily};
+    return {graphicsFamily, _queue.getFamilyIndex()};
+}
+
+VkDeviceSize StagingUploader::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+    VkDeviceSize offset;
+    while (!tryAllocate(size, alignment, offset)) {
+        retire(false);
+        if (tryAllocate(size, alignment, offset)) break;
+        if (!_bufferCopies.empty() || !_imageCopies.empty()) {
+            submit();
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        retire(true);
+        _statistics.stalls++;
+        _statistics.stallMilliseconds += std::chrono::duration<double, std::milli>(
+                                             std::chrono::steady_clock::now() - start)
+                                             .count();
+    }
+    return offset;
+}
+
+// Live data spans [_tail, _head), wrapping around the end of the ring when _head <= _tail.
+bool StagingUploader::tryAllocate(VkDeviceSize size, VkDeviceSize alignment,
+                                  VkDeviceSize& offset) {
+    if (isEmpty()) _head = _tail = 0;
+    VkDeviceSize aligned = alignUp(_head, alignment);
+    if (isEmpty() || _head > _tail) {
+        if (aligned + size <= _capacity) {
+            offset = aligned;
+        } else if (size <= _tail) {
+            offset = 0;
+        } else {
+            return false;
+        }
+    } else if (aligned + size <= _tail) {
+        offset = aligned;
+    } else {
+        return false;
+    }
+    _head = offset + size;
+    return true;
+}
+
+void StagingUploader::retire(bool block) {
+    VkDevice device = _device.getHandle();
+    while (!_inFlight.empty()) {
+        Batch& batch = _inFlight.front();
+        if (block) {
+            vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            block = false;
+        } else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS) {
+            break;
+        }
+        _tail = batch.ringEnd;
+        _completedBatch = batch.id;
+        _statistics.bytesUploaded += batch.bytes;
+        _lastRetire = std::chrono::steady_clock::now();
+        _freeBatches.push_back(batch);
+        _inFlight.pop_front();
+    }
+}
+
+StagingUploader::Batch StagingUploader::acquireBatch() {
+    VkDevice device = _device.getHandle();
+    if (!_freeBatches.empty()) {
+        Batch batch = _freeBatches.back();
+        _freeBatches.pop_back();
+        vkResetFences(device, 1, &batch.fence);
+        vkResetCommandBuffer(batch.commandBuffer, 0);
+        return batch;
+    }
+
+    Batch batch;
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = _commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate staging command buffer.");
+    }
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create staging fence.");
+    }
+    return batch;
+}
+
+uint64_t StagingUploader::submit() {
+    if (_bufferCopies.empty() && _imageCopies.empty()) return 0;
+
+    Batch batch = acquireBatch();
+    VkCommandBuffer cmd = batch.commandBuffer;
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmd, &beginInfo);
+
+    std::stable_sort(_bufferCopies.begin(), _bufferCopies.end(),
+                     [](const BufferCopy& a, const BufferCopy& b) {
+                         return std::less<VkBuffer>()(a.dst, b.dst);
+                     });
+    std::vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < _bufferCopies.size(); i++) {
+        regions.push_back(_bufferCopies[i].region);
+        if (i + 1 == _bufferCopies.size() || _bufferCopies[i + 1].dst != _bufferCopies[i].dst) {
+            vkCmdCopyBuffer(cmd, _ring.getHandle(), _bufferCopies[i].dst,
+                            static_cast<uint32_t>(regions.size()), regions.data());
+            regions.clear();
+        }
+    }
+
+    if (!_imageCopies.empty()) {
+        std::stable_sort(_imageCopies.begin(), _imageCopies.end(),
+                         [](const ImageCopy& a, const ImageCopy& b) {
+                             return std::less<VkImage>()(a.dst, b.dst);
+                         });
+        std::vector<VkImageMemoryBarrier> toTransfer;
+        std::vector<VkImageMemoryBarrier> toFinal;
+        for (auto& copy : _imageCopies) {
+            auto& layers = copy.region.imageSubresource;
+            VkImageSubresourceRange range = {layers.aspectMask, layers.mipLevel, 1,
+                                             layers.baseArrayLayer, layers.layerCount};
+            bool seen = std::any_of(toTransfer.begin(), toTransfer.end(), [&](auto& barrier) {
+                auto& other = barrier.subresourceRange;
+                return barrier.image == copy.dst && other.aspectMask == range.aspectMask &&
+                       other.baseMipLevel == range.baseMipLevel &&
+                       other.baseArrayLayer == range.baseArrayLayer &&
+                       other.layerCount == range.layerCount;
+            });
+            if (seen) continue;
+
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = copy.dst;
+            barrier.subresourceRange = range;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            toTransfer.push_back(barrier);
+
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = copy.finalLayout;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            toFinal.push_back(barrier);
+        }
+
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()),
+                             toTransfer.data());
+        std::vector<VkBufferImageCopy> imageRegions;
+        for (size_t i = 0; i < _imageCopies.size(); i++) {
+            imageRegions.push_back(_imageCopies[i].region);
+            if (i + 1 == _imageCopies.size() || _imageCopies[i + 1].dst != _imageCopies[i].dst) {
+                vkCmdCopyBufferToImage(cmd, _ring.getHandle(), _imageCopies[i].dst,
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                       static_cast<uint32_t>(imageRegions.size()),
+                                       imageRegions.data());
+                imageRegions.clear();
+            }
+        }
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+                             static_cast<uint32_t>(toFinal.size()), toFinal.data());
+    }
+
+    if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record staging command buffer.");
+    }
+
+    // No-op on host-coherent memory.
+    VmaAllocator allocator = _device.getAllocator().getHandle();
+    for (auto& copy : _bufferCopies) {
+        vmaFlushAllocation(allocator, _ring.getAllocation(), copy.region.srcOffset,
+                           copy.region.size);
+    }
+    for (auto& copy : _imageCopies) {
+        vmaFlushAllocation(allocator, _ring.getAllocation(), copy.region.bufferOffset, copy.size);
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    if (_queue.submit(1, &submitInfo, batch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit staging copies.");
+    }
+
+    if (_statistics.batches == 0) _firstSubmit = std::chrono::steady_clock::now();
+    _statistics.batches++;
+    batch.id = _nextBatch++;
+    batch.ringEnd = _head;
+    batch.bytes = _pendingBytes;
+    _inFlight.push_back(batch);
+    _bufferCopies.clear();
+    _imageCopies.clear();
+    _pendingBytes = 0;
+    return batch.id;
+}
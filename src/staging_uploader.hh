@@ -0,0 +1,105 @@
+#pragma once
+
+#include "application.hh"
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Streams data to device-local buffers and images through a persistently mapped ring buffer.
+// upload() only copies into the ring, flush() records every pending copy into one command
+// buffer submitted on the transfer queue, and ring space is recycled as soon as the fence of
+// the batch that used it signals.
+//
+// When the transfer queue has its own family, destinations must be created with
+// VK_SHARING_MODE_CONCURRENT over getQueueFamilies() : no ownership transfer is recorded.
+class StagingUploader {
+public:
+    struct Statistics {
+        uint64_t bytesUploaded = 0;
+        uint64_t batches = 0;
+        uint64_t stalls = 0;
+        double stallMilliseconds = 0.0;
+        double megabytesPerSecond = 0.0;
+    };
+
+    StagingUploader(LogicalDevice& device, VkDeviceSize capacity = 64 * 1024 * 1024);
+    ~StagingUploader();
+
+    StagingUploader(StagingUploader const&) = delete;
+    void operator=(StagingUploader const&) = delete;
+
+    // Buffer uploads larger than the ring are split into several copies.
+    void upload(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+
+    // region.bufferOffset is ignored. The copied subresource goes from UNDEFINED to
+    // TRANSFER_DST_OPTIMAL, discarding its previous contents, then to finalLayout.
+    void upload(const void* data, VkDeviceSize size, VkImage dst, const VkBufferImageCopy& region,
+                VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VkDeviceSize texelSize = 4);
+    void upload(const void* data, VkDeviceSize size, const Image& dst,
+                VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VkDeviceSize texelSize = 4);
+
+    // Submits pending copies and returns the id of their batch, 0 if nothing was pending.
+    uint64_t flush();
+    bool isComplete(uint64_t batch);
+    void wait(uint64_t batch);
+    void waitIdle();
+
+    Statistics getStatistics() const;
+
+    std::vector<uint32_t> getQueueFamilies() const;
+
+private:
+    struct BufferCopy {
+        VkBuffer dst;
+        VkBufferCopy region;
+    };
+    struct ImageCopy {
+        VkImage dst;
+        VkBufferImageCopy region;
+        VkDeviceSize size;
+        VkImageLayout finalLayout;
+    };
+    struct Batch {
+        uint64_t id = 0;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkDeviceSize ringEnd = 0;
+        VkDeviceSize bytes = 0;
+    };
+
+    LogicalDevice& _device;
+    Queue& _queue;
+    Buffer _ring;
+    uint8_t* _ringData;
+    VkDeviceSize _capacity;
+    VkDeviceSize _alignment;
+    VkDeviceSize _head = 0;
+    VkDeviceSize _tail = 0;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+
+    std::vector<BufferCopy> _bufferCopies;
+    std::vector<ImageCopy> _imageCopies;
+    VkDeviceSize _pendingBytes = 0;
+    std::deque<Batch> _inFlight;
+    std::vector<Batch> _freeBatches;
+    uint64_t _nextBatch = 1;
+    uint64_t _completedBatch = 0;
+
+    Statistics _statistics;
+    std::chrono::steady_clock::time_point _firstSubmit;
+    std::chrono::steady_clock::time_point _lastRetire;
+    mutable std::mutex _mutex;
+
+    VkDeviceSize allocate(VkDeviceSize size, VkDeviceSize alignment);
+    bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+    void retire(bool block);
+    uint64_t submit();
+    Batch acquireBatch();
+    bool isEmpty() const {
+        return _inFlight.empty() && _bufferCopies.empty() && _imageCopies.empty();
+    }
+};
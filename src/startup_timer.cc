@@ -0,0 +1,67 @@
+#include "startup_timer.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+static thread_local uint32_t threadDepth = 0;
+static thread_local uint32_t threadNumber = ~0u;
+
+static void writeEscaped(std::ostream& stream, const std::string& text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') stream << '\\';
+        stream << c;
+    }
+}
+
+size_t StartupTimer::begin(const std::string& name) {
+    if (_finished.load(std::memory_order_relaxed)) return unrecorded;
+    double start = getElapsedMilliseconds();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (threadNumber == ~0u) threadNumber = _threadCount++;
+    _phases.push_back({name, threadDepth++, threadNumber, start, -1.0});
+    return _phases.size() - 1;
+}
+
+void StartupTimer::end(size_t phase) {
+    if (phase == unrecorded) return;
+    double now = getElapsedMilliseconds();
+    std::lock_guard<std::mutex> lock(_mutex);
+    threadDepth--;
+    _phases[phase].durationMilliseconds = now - _phases[phase].startMilliseconds;
+}
+
+double StartupTimer::getElapsedMilliseconds() const {
+    return std::chrono::duration<double, std::milli>(Clock::now() - _origin).count();
+}
+
+std::vector<StartupTimer::Phase> StartupTimer::getPhases() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _phases;
+}
+
+void StartupTimer::writeJson(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) throw std::runtime_error("Can't open " + path + ".");
+
+    double total = getElapsedMilliseconds();
+    std::lock_guard<std::mutex> lock(_mutex);
+    file << "{\"totalMilliseconds\":" << total << ",\"phases\":[\n";
+    for (size_t i = 0; i < _phases.size(); i++) {
+        auto& phase = _phases[i];
+        file << "{\"name\":\"";
+        writeEscaped(file, phase.name);
+        file << "\",\"depth\":" << phase.depth << ",\"thread\":" << phase.thread
+             << ",\"start\":" << phase.startMilliseconds
+             << ",\"duration\":" << phase.durationMilliseconds << "}"
+             << (i + 1 < _phases.size() ? ",\n" : "\n");
+    }
+    file << "]}\n";
+}
+
+bool StartupTimer::writeJsonFromEnvironment() const {
+    const char* path = std::getenv("VKAPP_STARTUP_REPORT");
+    if (path == nullptr || *path == '\0') return false;
+    writeJson(path);
+    return true;
+}
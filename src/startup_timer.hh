@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Wall clock time of the bring-up phases (GLFW, instance, device probing, device creation),
+// nested by scope, for a machine-readable startup report. Time starts at the first
+// getInstance(), which main() calls before anything else, and recording stops at finish().
+class StartupTimer {
+public:
+    struct Phase {
+        std::string name;
+        // Nesting level within its thread, 0 for top-level phases.
+        uint32_t depth;
+        // Threads are numbered by their first phase, 0 being the one that started the timer.
+        uint32_t thread;
+        double startMilliseconds;
+        // Negative while the phase is still running.
+        double durationMilliseconds;
+    };
+
+    static StartupTimer& getInstance() {
+        static StartupTimer instance;
+        return instance;
+    }
+
+    StartupTimer(StartupTimer const&) = delete;
+    void operator=(StartupTimer const&) = delete;
+
+    // Returns the id end() expects. Nothing is recorded once finished.
+    size_t begin(const std::string& name);
+    void end(size_t phase);
+
+    // Called once the report is written : later phases (e.g. devices created at run time) would
+    // only grow the list nobody reads anymore.
+    void finish() {
+        _finished.store(true, std::memory_order_relaxed);
+    }
+
+    double getElapsedMilliseconds() const;
+    std::vector<Phase> getPhases() const;
+
+    // {"totalMilliseconds": ..., "phases": [{"name", "depth", "thread", "start", "duration"}]}
+    void writeJson(const std::string& path) const;
+
+    // Writes the report to $VKAPP_STARTUP_REPORT when it's set. Returns whether it did.
+    bool writeJsonFromEnvironment() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point _origin = Clock::now();
+    mutable std::mutex _mutex;
+    std::vector<Phase> _phases;
+    uint32_t _threadCount = 0;
+    std::atomic<bool> _finished{false};
+
+    static constexpr size_t unrecorded = ~size_t(0);
+
+    StartupTimer() = default;
+};
+
+// Times its scope as a startup phase.
+class StartupPhase {
+public:
+    explicit StartupPhase(const std::string& name)
+        : _phase(StartupTimer::getInstance().begin(name)) {
+    }
+
+    ~StartupPhase() {
+        StartupTimer::getInstance().end(_phase);
+    }
+
+    StartupPhase(StartupPhase const&) = delete;
+    void operator=(StartupPhase const&) = delete;
+
+private:
+    size_t _phase;
+};
@@ -0,0 +1,254 @@
+#include "swapchain.hh"
+
+#include <cmath>
+
+Swapchain::Swapchain(LogicalDevice& device, FrameScheduler& scheduler, Window& window,
+                     PresentPolicy policy /* = PresentPolicy::LowLatency */)
+    : _device(device),
+      _scheduler(scheduler),
+      _window(window),
+      _queue(device.getQueue(QueueRole::Graphics)),
+      _surface(window.getSurface()),
+      _policy(policy) {
+    if (!device.isExtensionEnabled(VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+        throw std::runtime_error("VK_KHR_swapchain isn't enabled on the device.");
+    }
+    VkPhysicalDevice physicalDevice = device.getPhysicalDevice().getHandle();
+    VkBool32 presentSupport = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, _queue.getFamilyIndex(), _surface,
+                                         &presentSupport);
+    if (!presentSupport) {
+        throw std::runtime_error("The graphics queue family can't present to the window.");
+    }
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, _surface, &formatCount, nullptr);
+    std::vector<VkSurfaceFormatKHR> formats(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, _surface, &formatCount, formats.data());
+    if (formats.empty()) throw std::runtime_error("The window surface has no format.");
+    _surfaceFormat = formats[0];
+    for (auto& format : formats) {
+        if (format.format == VK_FORMAT_B8G8R8A8_SRGB &&
+            format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            _surfaceFormat = format;
+        }
+    }
+    _presentMode = choosePresentMode();
+
+    for (uint32_t i = 0; i < scheduler.getFramesInFlight(); i++) {
+        _acquireSemaphores.push_back(createSemaphore());
+    }
+    recreate();
+    std::cerr << "Swapchain successfully created (" << getImageCount() << " images, present mode "
+              << _presentMode << ").\n";
+}
+
+Swapchain::~Swapchain() {
+    _scheduler.waitIdle();
+    for (auto& generation : _retired) destroy(generation);
+    destroy(_current);
+    for (auto semaphore : _acquireSemaphores) {
+        vkDestroySemaphore(_device.getHandle(), semaphore, nullptr);
+    }
+    std::cerr << "Destroyed swapchain.\n";
+}
+
+std::optional<uint32_t> Swapchain::acquire(uint32_t frameIndex) {
+    collectRetired();
+    if ((_outdated || _current.handle == VK_NULL_HANDLE) && !recreate()) {
+        _scheduler.skipFrame();
+        return std::nullopt;
+    }
+
+    uint32_t imageIndex;
+    VkResult result = vkAcquireNextImageKHR(_device.getHandle(), _current.handle, UINT64_MAX,
+                                            _acquireSemaphores[frameIndex], VK_NULL_HANDLE,
+                                            &imageIndex);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        recreate();
+        _scheduler.skipFrame();
+        return std::nullopt;
+    }
+    if (result == VK_SUBOPTIMAL_KHR) {
+        // The semaphore is signalled : render this frame and recreate after presenting it.
+        _outdated = true;
+    } else if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to acquire swapchain image.");
+    }
+    _current.lastFrame = _scheduler.getCurrentFrame();
+    return imageIndex;
+}
+
+void Swapchain::present(uint32_t imageIndex) {
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &_current.presentSemaphores[imageIndex];
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &_current.handle;
+    presentInfo.pImageIndices = &imageIndex;
+    VkResult result = _queue.present(presentInfo);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        _outdated = true;
+    } else if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to present swapchain image.");
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (_lastPresent) {
+        double interval = std::chrono::duration<double, std::milli>(now - *_lastPresent).count();
+        _intervals++;
+        double delta = interval - _intervalMean;
+        _intervalMean += delta / _intervals;
+        _intervalM2 += delta * (interval - _intervalMean);
+        _worstInterval = std::max(_worstInterval, interval);
+    }
+    _lastPresent = now;
+}
+
+Swapchain::PacingStatistics Swapchain::getPacingStatistics() const {
+    PacingStatistics statistics;
+    statistics.presents = _intervals + (_lastPresent ? 1 : 0);
+    statistics.meanMilliseconds = _intervalMean;
+    if (_intervals > 1) statistics.jitterMilliseconds = std::sqrt(_intervalM2 / (_intervals - 1));
+    statistics.worstMilliseconds = _worstInterval;
+    return statistics;
+}
+
+bool Swapchain::recreate() {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_device.getPhysicalDevice().getHandle(), _surface,
+                                              &capabilities);
+    VkExtent2D extent = capabilities.currentExtent;
+    if (extent.width == UINT32_MAX) {
+        extent = _window.getFramebufferExtent();
+        extent.width = std::clamp(extent.width, capabilities.minImageExtent.width,
+                                  capabilities.maxImageExtent.width);
+        extent.height = std::clamp(extent.height, capabilities.minImageExtent.height,
+                                   capabilities.maxImageExtent.height);
+    }
+    // Minimised : keep the current swapchain until the window has a size again.
+    if (extent.width == 0 || extent.height == 0) return false;
+
+    VkSwapchainCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = _surface;
+    createInfo.minImageCount = chooseImageCount(capabilities);
+    createInfo.imageFormat = _surfaceFormat.format;
+    createInfo.imageColorSpace = _surfaceFormat.colorSpace;
+    createInfo.imageExtent = extent;
+    createInfo.imageArrayLayers = 1;
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.preTransform = capabilities.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.presentMode = _presentMode;
+    createInfo.clipped = VK_TRUE;
+    createInfo.oldSwapchain = _current.handle;
+
+    Generation generation;
+    if (vkCreateSwapchainKHR(_device.getHandle(), &createInfo, nullptr, &generation.handle) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to create swapchain.");
+    }
+    uint32_t imageCount = 0;
+    vkGetSwapchainImagesKHR(_device.getHandle(), generation.handle, &imageCount, nullptr);
+    generation.images.resize(imageCount);
+    vkGetSwapchainImagesKHR(_device.getHandle(), generation.handle, &imageCount,
+                            generation.images.data());
+    for (auto image : generation.images) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = _surfaceFormat.format;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        VkImageView view;
+        if (vkCreateImageView(_device.getHandle(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            destroy(generation);
+            throw std::runtime_error("Failed to create swapchain image view.");
+        }
+        generation.imageViews.push_back(view);
+        generation.presentSemaphores.push_back(createSemaphore());
+    }
+
+    // Frames up to the current one may still use the old images.
+    if (_current.handle != VK_NULL_HANDLE) {
+        _current.lastFrame = _scheduler.getCurrentFrame();
+        _retired.push_back(std::move(_current));
+    }
+    _current = std::move(generation);
+    _extent = extent;
+    _outdated = false;
+    return true;
+}
+
+void Swapchain::destroy(Generation& generation) {
+    VkDevice device = _device.getHandle();
+    for (auto semaphore : generation.presentSemaphores) {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    for (auto view : generation.imageViews) vkDestroyImageView(device, view, nullptr);
+    if (generation.handle != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(device, generation.handle, nullptr);
+    }
+    generation = Generation();
+}
+
+void Swapchain::collectRetired() {
+    uint64_t completed = _scheduler.getCompletedFrame();
+    auto it = _retired.begin();
+    while (it != _retired.end()) {
+        if (it->lastFrame > completed) {
+            it++;
+            continue;
+        }
+        destroy(*it);
+        it = _retired.erase(it);
+    }
+}
+
+VkPresentModeKHR Swapchain::choosePresentMode() const {
+    uint32_t modeCount = 0;
+    VkPhysicalDevice physicalDevice = _device.getPhysicalDevice().getHandle();
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, _surface, &modeCount, nullptr);
+    std::vector<VkPresentModeKHR> modes(modeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, _surface, &modeCount, modes.data());
+
+    std::vector<VkPresentModeKHR> preferred;
+    switch (_policy) {
+        case PresentPolicy::LowLatency:
+            preferred = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR,
+                         VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+            break;
+        case PresentPolicy::Balanced:
+            preferred = {VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+        case PresentPolicy::PowerSaving:
+            break;
+    }
+    for (auto mode : preferred) {
+        if (std::find(modes.begin(), modes.end(), mode) != modes.end()) return mode;
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t Swapchain::chooseImageCount(const VkSurfaceCapabilitiesKHR& capabilities) const {
+    // Mailbox needs a spare image to replace the queued one without blocking. Other modes
+    // queue behind the displayed image, so every extra image is a frame of latency.
+    uint32_t count = _presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
+    count = std::max(count, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0) count = std::min(count, capabilities.maxImageCount);
+    return count;
+}
+
+VkSemaphore Swapchain::createSemaphore() {
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(_device.getHandle(), &semaphoreInfo, nullptr, &semaphore) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to create semaphore.");
+    }
+    return semaphore;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "application.hh"
+#include "frame_scheduler.hh"
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+// LowLatency takes whatever presents soonest even if it tears, Balanced never tears (MAILBOX,
+// else FIFO) and PowerSaving waits for vblank (FIFO, always available).
+enum class PresentPolicy { LowLatency, Balanced, PowerSaving };
+
+// Swapchain of a window, presented from the graphics queue. Recreation on out-of-date or
+// suboptimal results never idles the device : the old swapchain is handed to the new one and
+// destroyed once the frames that used it have completed on the FrameScheduler.
+//
+// Per frame : acquire(frame.index), render into getImage(), wait on getAcquireSemaphore()
+// and signal getPresentSemaphore() in FrameScheduler::endFrame(), then present().
+class Swapchain {
+public:
+    struct PacingStatistics {
+        uint64_t presents = 0;
+        double meanMilliseconds = 0.0;
+        // Standard deviation of present-to-present intervals.
+        double jitterMilliseconds = 0.0;
+        double worstMilliseconds = 0.0;
+    };
+
+    Swapchain(LogicalDevice& device, FrameScheduler& scheduler, Window& window,
+              PresentPolicy policy = PresentPolicy::LowLatency);
+    ~Swapchain();
+
+    Swapchain(Swapchain const&) = delete;
+    void operator=(Swapchain const&) = delete;
+
+    // Image index to render to, or nothing when the frame must be skipped (swapchain just
+    // recreated or window minimised). A skipped frame is already ended on the scheduler.
+    std::optional<uint32_t> acquire(uint32_t frameIndex);
+    void present(uint32_t imageIndex);
+
+    VkSemaphore getAcquireSemaphore(uint32_t frameIndex) const {
+        return _acquireSemaphores[frameIndex];
+    }
+
+    VkSemaphore getPresentSemaphore(uint32_t imageIndex) const {
+        return _current.presentSemaphores[imageIndex];
+    }
+
+    VkImage getImage(uint32_t imageIndex) const {
+        return _current.images[imageIndex];
+    }
+
+    VkImageView getImageView(uint32_t imageIndex) const {
+        return _current.imageViews[imageIndex];
+    }
+
+    uint32_t getImageCount() const {
+        return static_cast<uint32_t>(_current.images.size());
+    }
+
+    VkExtent2D getExtent() const {
+        return _extent;
+    }
+
+    VkFormat getFormat() const {
+        return _surfaceFormat.format;
+    }
+
+    VkPresentModeKHR getPresentMode() const {
+        return _presentMode;
+    }
+
+    PacingStatistics getPacingStatistics() const;
+
+private:
+    struct Generation {
+        VkSwapchainKHR handle = VK_NULL_HANDLE;
+        std::vector<VkImage> images;
+        std::vector<VkImageView> imageViews;
+        std::vector<VkSemaphore> presentSemaphores;
+        uint64_t lastFrame = 0;
+    };
+
+    LogicalDevice& _device;
+    FrameScheduler& _scheduler;
+    Window& _window;
+    Queue& _queue;
+    VkSurfaceKHR _surface;
+    PresentPolicy _policy;
+    VkSurfaceFormatKHR _surfaceFormat;
+    VkPresentModeKHR _presentMode;
+    VkExtent2D _extent = {0, 0};
+    Generation _current;
+    std::vector<Generation> _retired;
+    std::vector<VkSemaphore> _acquireSemaphores;
+    bool _outdated = false;
+
+    std::optional<std::chrono::steady_clock::time_point> _lastPresent;
+    uint64_t _intervals = 0;
+    double _intervalMean = 0.0;
+    double _intervalM2 = 0.0;
+    double _worstInterval = 0.0;
+
+    bool recreate();
+    void destroy(Generation& generation);
+    void collectRetired();
+    VkPresentModeKHR choosePresentMode() const;
+    uint32_t chooseImageCount(const VkSurfaceCapabilitiesKHR& capabilities) const;
+    VkSemaphore createSemaphore();
+};
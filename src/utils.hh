@@ -3,9 +3,29 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <string>
 
+// FNV-1a, fed piece by piece. Structs go in field by field so padding never reaches the hash.
+struct Hasher {
+    uint64_t value = 0xcbf29ce484222325ull;
+
+    void addBytes(const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            value ^= bytes[i];
+            value *= 0x100000001b3ull;
+        }
+    }
+
+    template <typename T>
+    void add(const T& field) {
+        addBytes(&field, sizeof(T));
+    }
+};
+
 inline std::ostream& operator<<(std::ostream& stream, const VkPhysicalDeviceType& type) {
     switch(type) {
         case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: